@@ -0,0 +1,654 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "hashmap.h"
+#include "set.h"
+#include "strv.h"
+
+/**
+ * SECTION:libudev-device-cache
+ * @short_description: live view of the current devices
+ *
+ * A device cache enumerates the devices once, and keeps the view current
+ * by applying the events sent by udevd. Lookups by syspath, device number
+ * and indexed properties do not access sysfs or the udev database.
+ */
+
+/**
+ * udev_device_cache:
+ *
+ * Opaque object representing a live view of the current devices.
+ */
+struct udev_device_cache {
+        struct udev *udev;
+        int refcount;
+        struct udev_monitor *monitor;
+        char **subsystems;
+        char **index_keys;
+        /* syspath -> device, holds the reference of the device */
+        Hashmap *devices;
+        /* id filename "b8:0" -> device */
+        Hashmap *devnums;
+        /* "KEY=value" -> Set of devices */
+        Hashmap *properties;
+        struct udev_list list;
+        void (*cb)(struct udev_device_cache *udev_device_cache,
+                   struct udev_device *udev_device, const char *action, void *userdata);
+        void *userdata;
+};
+
+/**
+ * udev_device_cache_new:
+ * @udev: udev library context
+ *
+ * Create a device cache. It is empty until udev_device_cache_start()
+ * is called.
+ *
+ * The initial refcount is 1, and needs to be decremented to
+ * release the resources of the udev device cache.
+ *
+ * Returns: the udev device cache, or #NULL on error.
+ **/
+_public_ struct udev_device_cache *udev_device_cache_new(struct udev *udev)
+{
+        struct udev_device_cache *cache;
+
+        if (udev == NULL)
+                return NULL;
+
+        cache = new0(struct udev_device_cache, 1);
+        if (cache == NULL)
+                return NULL;
+        cache->refcount = 1;
+        cache->udev = udev;
+        udev_list_init(udev, &cache->list, true);
+
+        cache->devices = hashmap_new(&string_hash_ops);
+        cache->devnums = hashmap_new(&string_hash_ops);
+        cache->properties = hashmap_new(&string_hash_ops);
+        if (cache->devices == NULL || cache->devnums == NULL || cache->properties == NULL) {
+                udev_device_cache_unref(cache);
+                return NULL;
+        }
+        return cache;
+}
+
+/**
+ * udev_device_cache_ref:
+ * @udev_device_cache: udev device cache
+ *
+ * Take a reference of a udev device cache.
+ *
+ * Returns: the passed udev device cache
+ **/
+_public_ struct udev_device_cache *udev_device_cache_ref(struct udev_device_cache *udev_device_cache)
+{
+        if (udev_device_cache == NULL)
+                return NULL;
+        udev_device_cache->refcount++;
+        return udev_device_cache;
+}
+
+static void property_index_remove(struct udev_device_cache *cache, struct udev_device *dev, const char *key)
+{
+        char name[UTIL_LINE_SIZE];
+        const char *value;
+        char *orig_name;
+        Set *devices;
+
+        value = udev_device_get_property_value(dev, key);
+        if (value == NULL)
+                return;
+
+        strscpyl(name, sizeof(name), key, "=", value, NULL);
+        devices = hashmap_get2(cache->properties, name, (void **) &orig_name);
+        if (devices == NULL)
+                return;
+        set_remove(devices, dev);
+        if (set_isempty(devices)) {
+                hashmap_remove(cache->properties, name);
+                set_free(devices);
+                free(orig_name);
+        }
+}
+
+static int property_index_add(struct udev_device_cache *cache, struct udev_device *dev, const char *key)
+{
+        const char *value;
+        char *name;
+        Set *devices;
+        int r;
+
+        value = udev_device_get_property_value(dev, key);
+        if (value == NULL)
+                return 0;
+
+        name = strjoin(key, "=", value, NULL);
+        if (name == NULL)
+                return -ENOMEM;
+
+        devices = hashmap_get(cache->properties, name);
+        if (devices == NULL) {
+                devices = set_new(NULL);
+                if (devices == NULL) {
+                        free(name);
+                        return -ENOMEM;
+                }
+                r = hashmap_put(cache->properties, name, devices);
+                if (r < 0) {
+                        set_free(devices);
+                        free(name);
+                        return r;
+                }
+        } else
+                free(name);
+
+        return set_put(devices, dev);
+}
+
+/* drop the device from all lookup tables, the reference is passed to the caller */
+static void device_unlink(struct udev_device_cache *cache, struct udev_device *dev)
+{
+        char **key;
+
+        hashmap_remove_value(cache->devices, udev_device_get_syspath(dev), dev);
+        if (major(udev_device_get_devnum(dev)) > 0)
+                hashmap_remove_value(cache->devnums, udev_device_get_id_filename(dev), dev);
+        STRV_FOREACH(key, cache->index_keys)
+                property_index_remove(cache, dev, *key);
+}
+
+/* add the device to all lookup tables, the cache takes over the reference */
+static int device_link(struct udev_device_cache *cache, struct udev_device *dev)
+{
+        char **key;
+        int r;
+
+        r = hashmap_put(cache->devices, udev_device_get_syspath(dev), dev);
+        if (r < 0)
+                return r;
+        if (major(udev_device_get_devnum(dev)) > 0) {
+                r = hashmap_replace(cache->devnums, udev_device_get_id_filename(dev), dev);
+                if (r < 0)
+                        goto fail;
+        }
+        STRV_FOREACH(key, cache->index_keys) {
+                r = property_index_add(cache, dev, *key);
+                if (r < 0)
+                        goto fail;
+        }
+        return 0;
+fail:
+        device_unlink(cache, dev);
+        return r;
+}
+
+static void notify(struct udev_device_cache *cache, struct udev_device *dev, const char *action)
+{
+        if (cache->cb != NULL)
+                cache->cb(cache, dev, action, cache->userdata);
+}
+
+static void properties_clear(Hashmap *properties)
+{
+        char *name;
+
+        while ((name = hashmap_first_key(properties)) != NULL) {
+                set_free(hashmap_remove(properties, name));
+                free(name);
+        }
+}
+
+static void devices_free(Hashmap *devices)
+{
+        struct udev_device *dev;
+
+        while ((dev = hashmap_steal_first(devices)) != NULL)
+                udev_device_unref(dev);
+        hashmap_free(devices);
+}
+
+static int sync_add_device(struct udev_enumerate *udev_enumerate, struct udev_device *dev, void *userdata)
+{
+        struct udev_device_cache *cache = userdata;
+        int r;
+
+        udev_device_ref(dev);
+        r = device_link(cache, dev);
+        if (r < 0)
+                udev_device_unref(dev);
+        return r;
+}
+
+/*
+ * Replace the content of the cache with a fresh enumeration, and report
+ * the difference: devices which are gone as "remove", new devices as "add",
+ * and all others as "change", as missed events might have changed them.
+ */
+static int cache_sync(struct udev_device_cache *cache)
+{
+        struct udev_enumerate *udev_enumerate;
+        Hashmap *old;
+        struct udev_device *dev;
+        char **subsystem;
+        Iterator i;
+        int r;
+
+        udev_enumerate = udev_enumerate_new(cache->udev);
+        if (udev_enumerate == NULL)
+                return -ENOMEM;
+        STRV_FOREACH(subsystem, cache->subsystems) {
+                r = udev_enumerate_add_match_subsystem(udev_enumerate, *subsystem);
+                if (r < 0)
+                        goto out;
+        }
+
+        /* keep the old devices, and start over with empty lookup tables */
+        old = cache->devices;
+        cache->devices = hashmap_new(&string_hash_ops);
+        if (cache->devices == NULL) {
+                cache->devices = old;
+                r = -ENOMEM;
+                goto out;
+        }
+        hashmap_clear(cache->devnums);
+        properties_clear(cache->properties);
+
+        r = udev_enumerate_scan_devices_stream(udev_enumerate, sync_add_device, cache);
+        if (r < 0)
+                log_debug_errno(r, "device cache: incomplete enumeration: %m");
+
+        HASHMAP_FOREACH(dev, old, i)
+                if (hashmap_get(cache->devices, udev_device_get_syspath(dev)) == NULL)
+                        notify(cache, dev, "remove");
+        HASHMAP_FOREACH(dev, cache->devices, i)
+                notify(cache, dev, hashmap_get(old, udev_device_get_syspath(dev)) != NULL ? "change" : "add");
+
+        devices_free(old);
+out:
+        udev_enumerate_unref(udev_enumerate);
+        return r;
+}
+
+static void cache_apply(struct udev_device_cache *cache, struct udev_device *dev)
+{
+        struct udev_device *old;
+        const char *action;
+
+        action = udev_device_get_action(dev);
+        if (action == NULL)
+                action = "change";
+
+        old = hashmap_get(cache->devices, udev_device_get_syspath(dev));
+        if (old != NULL) {
+                device_unlink(cache, old);
+                udev_device_unref(old);
+        }
+
+        if (streq(action, "remove")) {
+                if (old != NULL)
+                        notify(cache, dev, action);
+                udev_device_unref(dev);
+                return;
+        }
+
+        if (streq(action, "move") && udev_device_get_devpath_old(dev) != NULL) {
+                char path[UTIL_PATH_SIZE];
+
+                strscpyl(path, sizeof(path), "/sys", udev_device_get_devpath_old(dev), NULL);
+                old = hashmap_get(cache->devices, path);
+                if (old != NULL) {
+                        device_unlink(cache, old);
+                        udev_device_unref(old);
+                }
+        }
+
+        if (device_link(cache, dev) < 0) {
+                log_debug("device cache: unable to add '%s'", udev_device_get_syspath(dev));
+                udev_device_unref(dev);
+                return;
+        }
+        notify(cache, dev, action);
+}
+
+/**
+ * udev_device_cache_unref:
+ * @udev_device_cache: udev device cache
+ *
+ * Drop a reference of a udev device cache. If the refcount reaches zero,
+ * the resources of the device cache will be released.
+ *
+ * Returns: #NULL
+ **/
+_public_ struct udev_device_cache *udev_device_cache_unref(struct udev_device_cache *udev_device_cache)
+{
+        if (udev_device_cache == NULL)
+                return NULL;
+        udev_device_cache->refcount--;
+        if (udev_device_cache->refcount > 0)
+                return NULL;
+        udev_monitor_unref(udev_device_cache->monitor);
+        hashmap_free(udev_device_cache->devnums);
+        properties_clear(udev_device_cache->properties);
+        hashmap_free(udev_device_cache->properties);
+        devices_free(udev_device_cache->devices);
+        udev_list_cleanup(&udev_device_cache->list);
+        strv_free(udev_device_cache->subsystems);
+        strv_free(udev_device_cache->index_keys);
+        free(udev_device_cache);
+        return NULL;
+}
+
+/**
+ * udev_device_cache_get_udev:
+ * @udev_device_cache: udev device cache
+ *
+ * Returns: the udev library context of the device cache.
+ **/
+_public_ struct udev *udev_device_cache_get_udev(struct udev_device_cache *udev_device_cache)
+{
+        if (udev_device_cache == NULL)
+                return NULL;
+        return udev_device_cache->udev;
+}
+
+/**
+ * udev_device_cache_add_match_subsystem:
+ * @udev_device_cache: udev device cache
+ * @subsystem: subsystem of the devices to keep
+ *
+ * Restrict the cache to the devices of the given subsystems. Filters
+ * can only be added before udev_device_cache_start() is called.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ **/
+_public_ int udev_device_cache_add_match_subsystem(struct udev_device_cache *udev_device_cache, const char *subsystem)
+{
+        if (udev_device_cache == NULL || subsystem == NULL)
+                return -EINVAL;
+        if (udev_device_cache->monitor != NULL)
+                return -EBUSY;
+        return strv_extend(&udev_device_cache->subsystems, subsystem);
+}
+
+/**
+ * udev_device_cache_add_property_index:
+ * @udev_device_cache: udev device cache
+ * @property: property key
+ *
+ * Maintain an index of the values of a property, to look up devices
+ * with udev_device_cache_get_devices_by_property().
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ **/
+_public_ int udev_device_cache_add_property_index(struct udev_device_cache *udev_device_cache, const char *property)
+{
+        struct udev_device *dev;
+        char **key;
+        Iterator i;
+        int r;
+
+        if (udev_device_cache == NULL || property == NULL)
+                return -EINVAL;
+        STRV_FOREACH(key, udev_device_cache->index_keys)
+                if (streq(*key, property))
+                        return 0;
+
+        r = strv_extend(&udev_device_cache->index_keys, property);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(dev, udev_device_cache->devices, i) {
+                r = property_index_add(udev_device_cache, dev, property);
+                if (r < 0)
+                        return r;
+        }
+        return 0;
+}
+
+/**
+ * udev_device_cache_set_callback:
+ * @udev_device_cache: udev device cache
+ * @cb: function called for every change of the cache, or #NULL
+ * @userdata: data passed to @cb
+ *
+ * Install a callback which is called with the device and the action
+ * ("add", "remove", "change", "move", ...) of every device event applied
+ * to the cache. The device is owned by the cache.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ **/
+_public_ int udev_device_cache_set_callback(struct udev_device_cache *udev_device_cache,
+                                            void (*cb)(struct udev_device_cache *udev_device_cache,
+                                                       struct udev_device *udev_device,
+                                                       const char *action,
+                                                       void *userdata),
+                                            void *userdata)
+{
+        if (udev_device_cache == NULL)
+                return -EINVAL;
+        udev_device_cache->cb = cb;
+        udev_device_cache->userdata = userdata;
+        return 0;
+}
+
+/**
+ * udev_device_cache_start:
+ * @udev_device_cache: udev device cache
+ *
+ * Start listening to udev events and fill the cache with the current
+ * devices. Every device found is reported to the callback as "add".
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ **/
+_public_ int udev_device_cache_start(struct udev_device_cache *udev_device_cache)
+{
+        char **subsystem;
+        int r;
+
+        if (udev_device_cache == NULL)
+                return -EINVAL;
+        if (udev_device_cache->monitor != NULL)
+                return -EBUSY;
+
+        udev_device_cache->monitor = udev_monitor_new_from_netlink(udev_device_cache->udev, "udev");
+        if (udev_device_cache->monitor == NULL)
+                return -errno ?: -ENOMEM;
+
+        STRV_FOREACH(subsystem, udev_device_cache->subsystems) {
+                r = udev_monitor_filter_add_match_subsystem_devtype(udev_device_cache->monitor, *subsystem, NULL);
+                if (r < 0)
+                        goto fail;
+        }
+        udev_monitor_set_receive_buffer_size(udev_device_cache->monitor, 128*1024*1024);
+
+        /* listen before enumerating, no event must get lost in between */
+        r = udev_monitor_enable_receiving(udev_device_cache->monitor);
+        if (r < 0)
+                goto fail;
+
+        return cache_sync(udev_device_cache);
+fail:
+        udev_device_cache->monitor = udev_monitor_unref(udev_device_cache->monitor);
+        return r;
+}
+
+/**
+ * udev_device_cache_get_fd:
+ * @udev_device_cache: udev device cache
+ *
+ * Retrieve the file descriptor to poll() for pending events, which are
+ * applied with udev_device_cache_process().
+ *
+ * Returns: the file descriptor, or a negative error value.
+ **/
+_public_ int udev_device_cache_get_fd(struct udev_device_cache *udev_device_cache)
+{
+        if (udev_device_cache == NULL || udev_device_cache->monitor == NULL)
+                return -EINVAL;
+        return udev_monitor_get_fd(udev_device_cache->monitor);
+}
+
+/**
+ * udev_device_cache_process:
+ * @udev_device_cache: udev device cache
+ *
+ * Apply all pending events to the cache. If events were lost, because
+ * the socket buffer overflowed, the cache is refilled from a fresh
+ * enumeration.
+ *
+ * Returns: the number of events applied, otherwise a negative error value.
+ **/
+_public_ int udev_device_cache_process(struct udev_device_cache *udev_device_cache)
+{
+        struct udev_device *devices[32];
+        int n = 0;
+
+        if (udev_device_cache == NULL || udev_device_cache->monitor == NULL)
+                return -EINVAL;
+
+        for (;;) {
+                int r, i;
+
+                r = udev_monitor_receive_devices(udev_device_cache->monitor, devices, ELEMENTSOF(devices));
+                if (r == -ENOBUFS) {
+                        /* the queued events are older than the enumeration, drop them */
+                        log_debug("device cache: events lost, resynchronizing");
+                        while ((r = udev_monitor_receive_devices(udev_device_cache->monitor,
+                                                                 devices, ELEMENTSOF(devices))) > 0 ||
+                               r == -ENOBUFS)
+                                for (i = 0; i < r; i++)
+                                        udev_device_unref(devices[i]);
+                        cache_sync(udev_device_cache);
+                        n++;
+                        continue;
+                }
+                if (r <= 0)
+                        break;
+
+                for (i = 0; i < r; i++)
+                        cache_apply(udev_device_cache, devices[i]);
+                n += r;
+        }
+        return n;
+}
+
+/**
+ * udev_device_cache_get_device_by_syspath:
+ * @udev_device_cache: udev device cache
+ * @syspath: sys device path including sys directory
+ *
+ * The returned device is owned by the cache, and valid until the next
+ * call to udev_device_cache_process().
+ *
+ * Returns: the device, or #NULL if it is not known.
+ **/
+_public_ struct udev_device *udev_device_cache_get_device_by_syspath(struct udev_device_cache *udev_device_cache,
+                                                                     const char *syspath)
+{
+        if (udev_device_cache == NULL || syspath == NULL)
+                return NULL;
+        return hashmap_get(udev_device_cache->devices, syspath);
+}
+
+/**
+ * udev_device_cache_get_device_by_devnum:
+ * @udev_device_cache: udev device cache
+ * @type: char or block device
+ * @devnum: device major/minor number
+ *
+ * The returned device is owned by the cache, and valid until the next
+ * call to udev_device_cache_process().
+ *
+ * Returns: the device, or #NULL if it is not known.
+ **/
+_public_ struct udev_device *udev_device_cache_get_device_by_devnum(struct udev_device_cache *udev_device_cache,
+                                                                    char type, dev_t devnum)
+{
+        char id[64];
+
+        if (udev_device_cache == NULL || (type != 'b' && type != 'c'))
+                return NULL;
+        snprintf(id, sizeof(id), "%c%u:%u", type, major(devnum), minor(devnum));
+        return hashmap_get(udev_device_cache->devnums, id);
+}
+
+/**
+ * udev_device_cache_get_devices_by_property:
+ * @udev_device_cache: udev device cache
+ * @property: key of an indexed property
+ * @value: exact value of the property
+ *
+ * Look up the devices with a property value. The property must be indexed
+ * with udev_device_cache_add_property_index(). The returned list contains
+ * the syspaths of the devices, and is valid until the next call to a
+ * function returning a list of the cache.
+ *
+ * Returns: the first entry of the sorted list of syspaths.
+ **/
+_public_ struct udev_list_entry *udev_device_cache_get_devices_by_property(struct udev_device_cache *udev_device_cache,
+                                                                           const char *property, const char *value)
+{
+        char name[UTIL_LINE_SIZE];
+        struct udev_device *dev;
+        Set *devices;
+        Iterator i;
+
+        if (udev_device_cache == NULL || property == NULL || value == NULL)
+                return NULL;
+
+        udev_list_cleanup(&udev_device_cache->list);
+        strscpyl(name, sizeof(name), property, "=", value, NULL);
+        devices = hashmap_get(udev_device_cache->properties, name);
+        SET_FOREACH(dev, devices, i)
+                udev_list_entry_add(&udev_device_cache->list, udev_device_get_syspath(dev), NULL);
+        return udev_list_get_entry(&udev_device_cache->list);
+}
+
+/**
+ * udev_device_cache_get_list_entry:
+ * @udev_device_cache: udev device cache
+ *
+ * The returned list contains the syspaths of all devices in the cache,
+ * and is valid until the next call to a function returning a list of
+ * the cache.
+ *
+ * Returns: the first entry of the sorted list of syspaths.
+ **/
+_public_ struct udev_list_entry *udev_device_cache_get_list_entry(struct udev_device_cache *udev_device_cache)
+{
+        struct udev_device *dev;
+        Iterator i;
+
+        if (udev_device_cache == NULL)
+                return NULL;
+
+        udev_list_cleanup(&udev_device_cache->list);
+        HASHMAP_FOREACH(dev, udev_device_cache->devices, i)
+                udev_list_entry_add(&udev_device_cache->list, udev_device_get_syspath(dev), NULL);
+        return udev_list_get_entry(&udev_device_cache->list);
+}
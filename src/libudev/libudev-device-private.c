@@ -24,11 +24,100 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 
 #include "libudev.h"
 #include "libudev-private.h"
+#include "strv.h"
+
+/*
+ * Create an empty index file, if it does not exist yet. An existing file is
+ * left alone, so repeated events of a device do not touch the index.
+ */
+static bool index_entry_create(const char *filename)
+{
+        int fd;
+
+        fd = open(filename, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_NOFOLLOW, 0444);
+        if (fd < 0 && errno == ENOENT) {
+                mkdir_parents(filename, 0755);
+                fd = open(filename, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC|O_NOFOLLOW, 0444);
+        }
+        if (fd < 0)
+                return false;
+        close(fd);
+        return true;
+}
+
+/* the format of the files in /run/udev/tags-index/ is described in libudev-tag-index.c */
+#define TAG_INDEX_DIR UDEV_ROOT_RUN "/udev/tags-index"
+/* smaller files are not compacted */
+#define TAG_INDEX_COMPACT_SIZE (64 * 1024)
+
+static void tag_index_append(struct udev_device *dev, const char *tag, bool add)
+{
+        char filename[UTIL_PATH_SIZE];
+        char record[UTIL_PATH_SIZE * 2];
+        const char *subsystem;
+        int len = -1;
+        int r;
+
+        strscpyl(filename, sizeof(filename), TAG_INDEX_DIR "/", tag, NULL);
+
+        subsystem = udev_device_get_subsystem(dev);
+        if (add && subsystem != NULL)
+                len = snprintf(record, sizeof(record), "+%s %s %s\n",
+                               udev_device_get_id_filename(dev), subsystem, udev_device_get_devpath(dev));
+        else if (!add)
+                len = snprintf(record, sizeof(record), "-%s\n", udev_device_get_id_filename(dev));
+        if (len < 0 || (size_t) len >= sizeof(record)) {
+                r = -EINVAL;
+                goto fail;
+        }
+
+        for (;;) {
+                _cleanup_close_ int fd = -1;
+                struct stat st, st_path;
+                ssize_t l;
+
+                /* udevd creates the file, when it is idle */
+                fd = open(filename, O_WRONLY|O_APPEND|O_CLOEXEC|O_NOFOLLOW);
+                if (fd < 0 && errno == ENOENT)
+                        return;
+                if (fd < 0) {
+                        r = -errno;
+                        goto fail;
+                }
+
+                /* the file might have been replaced by udevd, before we got the lock */
+                if (flock(fd, LOCK_SH) < 0 || fstat(fd, &st) < 0) {
+                        r = -errno;
+                        goto fail;
+                }
+                if (stat(filename, &st_path) < 0) {
+                        if (errno == ENOENT)
+                                return;
+                        r = -errno;
+                        goto fail;
+                }
+                if (st.st_ino != st_path.st_ino || st.st_dev != st_path.st_dev)
+                        continue;
+
+                l = write(fd, record, len);
+                if (l == len)
+                        return;
+                r = l < 0 ? -errno : -EIO;
+                goto fail;
+        }
+
+fail:
+        /* a file which misses a change is not used, udevd builds a new one */
+        log_debug_errno(r, "unable to append to '%s', dropping it: %m", filename);
+        unlink(filename);
+}
 
 static void udev_device_tag(struct udev_device *dev, const char *tag, bool add)
 {
@@ -41,14 +130,12 @@ static void udev_device_tag(struct udev_device *dev, const char *tag, bool add)
         strscpyl(filename, sizeof(filename), UDEV_ROOT_RUN "/udev/tags/", tag, "/", id, NULL);
 
         if (add) {
-                int fd;
-
-                mkdir_parents(filename, 0755);
-                fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                if (fd >= 0)
-                        close(fd);
+                /* a renamed device keeps its id, but changes its devpath */
+                if (index_entry_create(filename) || udev_device_get_devpath_old(dev) != NULL)
+                        tag_index_append(dev, tag, true);
         } else {
-                unlink(filename);
+                if (unlink(filename) == 0)
+                        tag_index_append(dev, tag, false);
         }
 }
 
@@ -101,12 +188,172 @@ static bool device_has_info(struct udev_device *udev_device)
         return false;
 }
 
+static void udev_device_property(struct udev_device *dev, const char *key, const char *value, bool add)
+{
+        const char *id;
+        char value_enc[NAME_MAX+1];
+        char filename[UTIL_PATH_SIZE];
+
+        id = udev_device_get_id_filename(dev);
+        if (id == NULL)
+                return;
+        if (util_property_index_encode(value, value_enc, sizeof(value_enc)) < 0)
+                return;
+        strscpyl(filename, sizeof(filename), UDEV_ROOT_RUN "/udev/property/", key, "/", value_enc, "/", id, NULL);
+
+        if (add)
+                index_entry_create(filename);
+        else
+                unlink(filename);
+}
+
+/*
+ * The property index works like the tag index: the indexed keys are the
+ * directories in /run/udev/property/, set up by udevd, and every device
+ * with such a property has an entry <key>/<value>/<id>.
+ */
+int udev_device_property_index(struct udev_device *dev, struct udev_device *dev_old, bool add)
+{
+        DIR *dir;
+        struct dirent *dent;
+
+        dir = opendir(UDEV_ROOT_RUN "/udev/property");
+        if (dir == NULL)
+                return 0;
+
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                const char *key = dent->d_name;
+                const char *value;
+
+                if (key[0] == '.')
+                        continue;
+
+                value = udev_device_get_property_value(dev, key);
+
+                if (add && dev_old != NULL) {
+                        const char *value_old;
+
+                        /* delete possible left-over value */
+                        value_old = udev_device_get_property_value(dev_old, key);
+                        if (value_old != NULL && !streq_ptr(value, value_old))
+                                udev_device_property(dev_old, key, value_old, false);
+                }
+
+                if (value != NULL)
+                        udev_device_property(dev, key, value, add);
+        }
+
+        closedir(dir);
+        return 0;
+}
+
+/*
+ * Add the devices in the database to the index of newly configured keys.
+ * Only the database files are read, no device is created; the properties
+ * of devices which are not in the database yet are indexed by the workers,
+ * like all later changes.
+ */
+int property_index_fill(char * const *keys)
+{
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *dent;
+
+        dir = opendir(UDEV_ROOT_RUN "/udev/data");
+        if (dir == NULL)
+                return errno == ENOENT ? 0 : -errno;
+
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                _cleanup_fclose_ FILE *f = NULL;
+                char line[UTIL_LINE_SIZE];
+                int fd;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                fd = openat(dirfd(dir), dent->d_name, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+                if (fd < 0)
+                        continue;
+                f = fdopen(fd, "re");
+                if (f == NULL) {
+                        close(fd);
+                        continue;
+                }
+
+                while (fgets(line, sizeof(line), f) != NULL) {
+                        char value_enc[NAME_MAX+1];
+                        char filename[UTIL_PATH_SIZE];
+                        char * const *key;
+                        char *value;
+
+                        if (!startswith(line, "E:"))
+                                continue;
+                        value = strchr(line, '=');
+                        if (value == NULL)
+                                continue;
+                        value[0] = '\0';
+                        value = truncate_nl(&value[1]);
+                        if (value[0] == '\0')
+                                continue;
+
+                        STRV_FOREACH(key, keys) {
+                                if (!streq(*key, &line[2]))
+                                        continue;
+                                if (util_property_index_encode(value, value_enc, sizeof(value_enc)) < 0)
+                                        break;
+                                strscpyl(filename, sizeof(filename), UDEV_ROOT_RUN "/udev/property/",
+                                         *key, "/", value_enc, "/", dent->d_name, NULL);
+                                index_entry_create(filename);
+                                break;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * Check if the database file has the given content already. It is not
+ * touched then; watchers of /run/udev/data see only real changes.
+ */
+static bool db_unchanged(const char *filename, const char *buf, size_t len, bool persist)
+{
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *old = NULL;
+        struct stat st;
+        ssize_t l;
+
+        fd = open(filename, O_RDONLY|O_CLOEXEC|O_NOFOLLOW);
+        if (fd < 0)
+                return false;
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+                return false;
+        if ((size_t) st.st_size != len)
+                return false;
+        if (!!(st.st_mode & S_ISVTX) != persist)
+                return false;
+
+        if (len > 0) {
+                old = malloc(len);
+                if (old == NULL)
+                        return false;
+                l = pread(fd, old, len, 0);
+                if (l < 0 || (size_t) l != len)
+                        return false;
+                if (memcmp(old, buf, len) != 0)
+                        return false;
+        }
+
+        return true;
+}
+
 int udev_device_update_db(struct udev_device *udev_device)
 {
         bool has_info;
         const char *id;
         char filename[UTIL_PATH_SIZE];
         char filename_tmp[UTIL_PATH_SIZE];
+        _cleanup_free_ char *buf = NULL;
+        size_t len = 0;
         FILE *f;
         int r;
 
@@ -125,19 +372,10 @@ int udev_device_update_db(struct udev_device *udev_device)
                 return 0;
         }
 
-        /* write a database file */
-        strscpyl(filename_tmp, sizeof(filename_tmp), filename, ".tmp", NULL);
-        mkdir_parents(filename_tmp, 0755);
-        f = fopen(filename_tmp, "we");
+        /* format the database file, and leave it alone if nothing changed */
+        f = open_memstream(&buf, &len);
         if (f == NULL)
-                return log_debug_errno(errno, "unable to create temporary db file '%s': %m", filename_tmp);
-
-        /*
-         * set 'sticky' bit to indicate that we should not clean the
-         * database when we transition from initramfs to the real root
-         */
-        if (udev_device_get_db_persist(udev_device))
-                fchmod(fileno(f), 01644);
+                return -ENOMEM;
 
         if (has_info) {
                 struct udev_list_entry *list_entry;
@@ -166,7 +404,35 @@ int udev_device_update_db(struct udev_device *udev_device)
                         fprintf(f, "G:%s\n", udev_list_entry_get_name(list_entry));
         }
 
+        if (fclose(f) != 0)
+                return -ENOMEM;
+
+        if (db_unchanged(filename, buf, len, udev_device_get_db_persist(udev_device))) {
+                log_debug("unchanged db file '%s' for '%s'", filename, udev_device_get_devpath(udev_device));
+                return 0;
+        }
+
+        /* write a database file */
+        strscpyl(filename_tmp, sizeof(filename_tmp), filename, ".tmp", NULL);
+        mkdir_parents(filename_tmp, 0755);
+        f = fopen(filename_tmp, "we");
+        if (f == NULL)
+                return log_debug_errno(errno, "unable to create temporary db file '%s': %m", filename_tmp);
+
+        /*
+         * set 'sticky' bit to indicate that we should not clean the
+         * database when we transition from initramfs to the real root
+         */
+        if (udev_device_get_db_persist(udev_device))
+                fchmod(fileno(f), 01644);
+
+        fwrite(buf, 1, len, f);
+        r = fflush(f);
         fclose(f);
+        if (r != 0) {
+                unlink(filename_tmp);
+                return -1;
+        }
         r = rename(filename_tmp, filename);
         if (r < 0)
                 return -1;
@@ -188,3 +454,222 @@ int udev_device_delete_db(struct udev_device *udev_device)
         unlink(filename);
         return 0;
 }
+
+/* replace the index file of the tag; the caller holds the lock of the current one */
+static int tag_index_write(int dfd, const char *tag, const char *buf, size_t len)
+{
+        char filename_tmp[UTIL_PATH_SIZE];
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        strscpyl(filename_tmp, sizeof(filename_tmp), TAG_INDEX_DIR "/.#", tag, "XXXXXX", NULL);
+        fd = mkostemp(filename_tmp, O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        if (fchmod(fd, 0644) < 0 ||
+            (len > 0 && loop_write(fd, buf, len, false) < 0)) {
+                r = -errno;
+                unlink(filename_tmp);
+                return r;
+        }
+
+        if (renameat(AT_FDCWD, filename_tmp, dfd, tag) < 0) {
+                r = -errno;
+                unlink(filename_tmp);
+                return r;
+        }
+        return 0;
+}
+
+/* build the index file of a tag from its directory */
+static int tag_index_rebuild(struct udev *udev, int dfd, const char *tag)
+{
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_close_ int dfd_index = -1;
+        _cleanup_free_ char *buf = NULL;
+        struct dirent *dent;
+        size_t len = 0;
+        FILE *f;
+        int fd;
+
+        fd = openat(dfd, tag, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+        dir = fdopendir(fd);
+        if (dir == NULL) {
+                close(fd);
+                return -errno;
+        }
+
+        f = open_memstream(&buf, &len);
+        if (f == NULL)
+                return -ENOMEM;
+
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                struct udev_device *dev;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                dev = udev_device_new_from_device_id(udev, dent->d_name);
+                if (dev == NULL)
+                        continue;
+                if (udev_device_get_subsystem(dev) != NULL)
+                        fprintf(f, "+%s %s %s\n", dent->d_name,
+                                udev_device_get_subsystem(dev), udev_device_get_devpath(dev));
+                udev_device_unref(dev);
+        }
+
+        if (fclose(f) != 0)
+                return -ENOMEM;
+
+        dfd_index = open(TAG_INDEX_DIR, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dfd_index < 0)
+                return -errno;
+        return tag_index_write(dfd_index, tag, buf, len);
+}
+
+/* a record which is not completely written, e.g. by a killed worker */
+static bool tag_index_truncated(int dfd, const char *tag)
+{
+        _cleanup_close_ int fd = -1;
+        struct stat st;
+        char c;
+
+        fd = openat(dfd, tag, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+        if (fd < 0 || fstat(fd, &st) < 0)
+                return true;
+        if (st.st_size == 0)
+                return false;
+        return pread(fd, &c, 1, st.st_size - 1) != 1 || c != '\n';
+}
+
+/*
+ * Drop the index files which can not be trusted anymore; the missing
+ * ones are built by tag_index_compact(), when udevd is idle.
+ */
+int tag_index_setup(void)
+{
+        _cleanup_closedir_ DIR *dir_index = NULL;
+        struct dirent *dent;
+        int r;
+
+        r = udev_mkdir_p(TAG_INDEX_DIR, 0755);
+        if (r < 0)
+                return r;
+
+        dir_index = opendir(TAG_INDEX_DIR);
+        if (dir_index == NULL)
+                return -errno;
+        for (dent = readdir(dir_index); dent != NULL; dent = readdir(dir_index)) {
+                char path[UTIL_PATH_SIZE];
+                struct stat st;
+
+                /* left-over temporary file */
+                if (startswith(dent->d_name, ".#")) {
+                        unlinkat(dirfd(dir_index), dent->d_name, 0);
+                        continue;
+                }
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                /* a tag without any device */
+                strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/tags/", dent->d_name, NULL);
+                if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode) ||
+                    tag_index_truncated(dirfd(dir_index), dent->d_name))
+                        unlinkat(dirfd(dir_index), dent->d_name, 0);
+        }
+        return 0;
+}
+
+/* drop all index files, after a worker was killed while it might have been appending to one */
+void tag_index_invalidate(void)
+{
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *dent;
+
+        dir = opendir(TAG_INDEX_DIR);
+        if (dir == NULL)
+                return;
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir))
+                if (dent->d_name[0] != '.')
+                        unlinkat(dirfd(dir), dent->d_name, 0);
+}
+
+/*
+ * Build the index files of the tags which have none, and rewrite the ones
+ * which grew large, with only the current device of every id. Called by
+ * udevd when it is idle, no worker appends to the files then.
+ */
+void tag_index_compact(struct udev *udev)
+{
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_close_ int dfd_index = -1;
+        struct dirent *dent;
+
+        dir = opendir(UDEV_ROOT_RUN "/udev/tags");
+        if (dir == NULL)
+                return;
+        dfd_index = open(TAG_INDEX_DIR, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (dfd_index < 0)
+                return;
+
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                _cleanup_tag_index_free_ struct tag_index *index = NULL;
+                _cleanup_close_ int fd = -1;
+                _cleanup_free_ char *buf = NULL;
+                struct stat st, st_path;
+                size_t len = 0;
+                size_t i;
+                FILE *f;
+                int r;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                fd = openat(dfd_index, dent->d_name, O_RDONLY|O_NOFOLLOW|O_CLOEXEC);
+                if (fd < 0 && errno == ENOENT) {
+                        r = tag_index_rebuild(udev, dirfd(dir), dent->d_name);
+                        if (r < 0)
+                                log_debug_errno(r, "unable to build the index of tag '%s': %m", dent->d_name);
+                        else
+                                log_debug("built the index of tag '%s'", dent->d_name);
+                        continue;
+                }
+                if (fd < 0)
+                        continue;
+                if (fstat(fd, &st) < 0)
+                        continue;
+
+                /* wait for the running appends */
+                if (flock(fd, LOCK_EX) < 0)
+                        continue;
+                if (fstatat(dfd_index, dent->d_name, &st_path, AT_SYMLINK_NOFOLLOW) < 0 ||
+                    st.st_ino != st_path.st_ino)
+                        continue;
+
+                if (st.st_size < TAG_INDEX_COMPACT_SIZE)
+                        continue;
+                if (tag_index_load_fd(fd, &index) < 0)
+                        continue;
+                if (index->records < index->entries_count * 2)
+                        continue;
+
+                f = open_memstream(&buf, &len);
+                if (f == NULL)
+                        return;
+                for (i = 0; i < index->entries_count; i++)
+                        fprintf(f, "+%s %s %s\n", index->entries[i].id,
+                                index->entries[i].subsystem, index->entries[i].devpath);
+                if (fclose(f) != 0)
+                        return;
+
+                r = tag_index_write(dfd_index, dent->d_name, buf, len);
+                if (r < 0)
+                        log_debug_errno(r, "unable to compact the index of tag '%s': %m", dent->d_name);
+                else
+                        log_debug("compacted the index of tag '%s' from %zu to %zu records",
+                                  dent->d_name, index->records, index->entries_count);
+        }
+}
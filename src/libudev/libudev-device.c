@@ -36,8 +36,10 @@
 
 #include "libudev.h"
 #include "libudev-private.h"
+#include "strv.h"
 
 static int udev_device_read_uevent_file(struct udev_device *udev_device);
+static void udev_device_update_properties(struct udev_device *udev_device);
 static int udev_device_set_devnode(struct udev_device *udev_device, const char *devnode);
 static struct udev_list_entry *udev_device_add_property_internal(struct udev_device *udev_device, const char *key, const char *value);
 
@@ -104,6 +106,28 @@ struct udev_device {
         bool db_persist;
 };
 
+/*
+ * Sysfs paths of devices are deep; when many files of a device are read
+ * at once, an O_PATH fd of its directory is opened for the batch, and the
+ * files are accessed relative to it. The fd is closed when the batch is
+ * done; devices do not keep it, consumers may hold many thousands of them,
+ * and the directory might be a different device by the next access.
+ */
+static int udev_device_open_syspath(struct udev_device *udev_device)
+{
+        int fd;
+
+        if (udev_device->syspath == NULL)
+                return AT_FDCWD;
+
+        /* fall back to absolute paths */
+        fd = open(udev_device->syspath, O_PATH|O_DIRECTORY|O_CLOEXEC);
+        if (fd < 0)
+                return AT_FDCWD;
+
+        return fd;
+}
+
 /**
  * udev_device_get_seqnum:
  * @udev_device: udev device
@@ -370,8 +394,8 @@ static struct udev_list_entry *udev_device_add_property_internal(struct udev_dev
         if (value == NULL) {
                 struct udev_list_entry *list_entry;
 
-                list_entry = udev_device_get_properties_list_entry(udev_device);
-                list_entry = udev_list_entry_get_by_name(list_entry, key);
+                udev_device_update_properties(udev_device);
+                list_entry = udev_list_get_entry_by_name(&udev_device->properties_list, key);
                 if (list_entry != NULL)
                         udev_list_entry_delete(list_entry);
                 return NULL;
@@ -409,6 +433,80 @@ static struct udev_list_entry *udev_device_add_property_from_string(struct udev_
         return udev_device_add_property_internal(udev_device, name, val);
 }
 
+/* like udev_device_add_property_from_string(), but splits the string in place */
+static struct udev_list_entry *udev_device_add_property_split(struct udev_device *udev_device, char *property)
+{
+        char *val;
+
+        val = strchr(property, '=');
+        if (val == NULL)
+                return NULL;
+        val[0] = '\0';
+        val = &val[1];
+        if (val[0] == '\0')
+                val = NULL;
+        return udev_device_add_property_internal(udev_device, property, val);
+}
+
+/*
+ * Read a whole file, with a single read() in the common case. Files which
+ * fit are read into the caller's buffer, larger ones into an allocated one,
+ * which the caller frees if it differs from its own. The content is
+ * NUL-terminated, so it can be parsed in place.
+ */
+static int read_file_at(int dfd, const char *path, char *buf, size_t size, char **ret)
+{
+        _cleanup_close_ int fd = -1;
+        char *data = buf;
+        size_t len = 0;
+        int r;
+
+        fd = openat(dfd, path, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        for (;;) {
+                ssize_t k;
+
+                if (len + 1 >= size) {
+                        char *t;
+
+                        if (size >= 4*1024*1024) {
+                                r = -E2BIG;
+                                goto fail;
+                        }
+                        t = realloc(data != buf ? data : NULL, size * 2);
+                        if (t == NULL) {
+                                r = -ENOMEM;
+                                goto fail;
+                        }
+                        if (data == buf)
+                                memcpy(t, buf, len);
+                        data = t;
+                        size *= 2;
+                }
+
+                k = read(fd, data + len, size - len - 1);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        r = -errno;
+                        goto fail;
+                }
+                if (k == 0)
+                        break;
+                len += k;
+        }
+
+        data[len] = '\0';
+        *ret = data;
+        return 0;
+fail:
+        if (data != buf)
+                free(data);
+        return r;
+}
+
 static int udev_device_set_syspath(struct udev_device *udev_device, const char *syspath)
 {
         const char *pos;
@@ -589,17 +687,18 @@ _public_ const char *udev_device_get_property_value(struct udev_device *udev_dev
         if (key == NULL)
                 return NULL;
 
-        list_entry = udev_device_get_properties_list_entry(udev_device);
-        list_entry = udev_list_entry_get_by_name(list_entry, key);
+        udev_device_update_properties(udev_device);
+        list_entry = udev_list_get_entry_by_name(&udev_device->properties_list, key);
         return udev_list_entry_get_value(list_entry);
 }
 
 int udev_device_read_db(struct udev_device *udev_device)
 {
         char filename[UTIL_PATH_SIZE];
-        char line[UTIL_LINE_SIZE];
+        char buf[4096];
+        char *data, *line, *next;
         const char *id;
-        FILE *f;
+        int r;
 
         if (udev_device->db_loaded)
                 return 0;
@@ -612,22 +711,23 @@ int udev_device_read_db(struct udev_device *udev_device)
 
         strscpyl(filename, sizeof(filename), UDEV_ROOT_RUN "/udev/data/", id, NULL);
 
-        f = fopen(filename, "re");
-        if (f == NULL)
-                return log_debug_errno(errno, "no db file to read %s: %m", filename);
+        r = read_file_at(AT_FDCWD, filename, buf, sizeof(buf), &data);
+        if (r < 0)
+                return log_debug_errno(r, "no db file to read %s: %m", filename);
 
         /* devices with a database entry are initialized */
         udev_device->is_initialized = true;
 
-        while (fgets(line, sizeof(line), f)) {
-                ssize_t len;
-                const char *val;
+        for (line = data; line[0] != '\0'; line = next) {
+                char *val;
                 struct udev_list_entry *entry;
 
-                len = strlen(line);
-                if (len < 4)
+                next = strchr(line, '\n');
+                if (next == NULL || next - line < 3)
                         break;
-                line[len-1] = '\0';
+                next[0] = '\0';
+                next++;
+
                 val = &line[2];
                 switch(line[0]) {
                 case 'S':
@@ -638,7 +738,7 @@ int udev_device_read_db(struct udev_device *udev_device)
                         udev_device_set_devlink_priority(udev_device, atoi(val));
                         break;
                 case 'E':
-                        entry = udev_device_add_property_from_string(udev_device, val);
+                        entry = udev_device_add_property_split(udev_device, val);
                         udev_list_entry_set_num(entry, true);
                         break;
                 case 'G':
@@ -652,7 +752,8 @@ int udev_device_read_db(struct udev_device *udev_device)
                         break;
                 }
         }
-        fclose(f);
+        if (data != buf)
+                free(data);
 
         log_trace("device %p filled with db file data", udev_device);
         return 0;
@@ -661,27 +762,27 @@ int udev_device_read_db(struct udev_device *udev_device)
 static int udev_device_read_uevent_file(struct udev_device *udev_device)
 {
         char filename[UTIL_PATH_SIZE];
-        FILE *f;
-        char line[UTIL_LINE_SIZE];
+        char buf[4096];
+        char *data, *line, *next;
         int maj = 0;
         int min = 0;
+        int r;
 
         if (udev_device->uevent_loaded)
                 return 0;
 
         strscpyl(filename, sizeof(filename), udev_device->syspath, "/uevent", NULL);
-        f = fopen(filename, "re");
-        if (f == NULL)
-                return -errno;
+        r = read_file_at(AT_FDCWD, filename, buf, sizeof(buf), &data);
+        if (r < 0)
+                return r;
         udev_device->uevent_loaded = true;
 
-        while (fgets(line, sizeof(line), f)) {
-                char *pos;
-
-                pos = strchr(line, '\n');
-                if (pos == NULL)
-                        continue;
-                pos[0] = '\0';
+        for (line = data; line[0] != '\0'; line = next) {
+                next = strchr(line, '\n');
+                if (next == NULL)
+                        break;
+                next[0] = '\0';
+                next++;
 
                 if (startswith(line, "DEVTYPE=")) {
                         udev_device_set_devtype(udev_device, &line[8]);
@@ -703,11 +804,12 @@ static int udev_device_read_uevent_file(struct udev_device *udev_device)
                 else if (startswith(line, "DEVMODE="))
                         udev_device->devnode_mode = strtoul(&line[8], NULL, 8);
 
-                udev_device_add_property_from_string(udev_device, line);
+                udev_device_add_property_split(udev_device, line);
         }
 
         udev_device->devnum = makedev(maj, min);
-        fclose(f);
+        if (data != buf)
+                free(data);
         return 0;
 }
 
@@ -725,18 +827,23 @@ static struct udev_device *udev_device_new(struct udev *udev)
                 return NULL;
         }
 
-        udev_device = new0(struct udev_device, 1);
+        udev_device = udev_alloc0(udev, sizeof(struct udev_device));
         if (udev_device == NULL) {
                 errno = ENOMEM;
                 return NULL;
         }
         udev_device->refcount = 1;
-        udev_device->udev = udev;
+        /* the device's lists are allocated from the context */
+        udev_device->udev = udev_ref(udev);
         udev_list_init(udev, &udev_device->devlinks_list, true);
         udev_list_init(udev, &udev_device->properties_list, true);
         udev_list_init(udev, &udev_device->sysattr_value_list, true);
         udev_list_init(udev, &udev_device->sysattr_list, false);
         udev_list_init(udev, &udev_device->tags_list, true);
+        udev_device->properties_list.interned = true;
+        udev_device->sysattr_value_list.interned = true;
+        udev_device->sysattr_list.interned = true;
+        udev_device->tags_list.interned = true;
         udev_device->watch_handle = -1;
 
         return udev_device;
@@ -1205,6 +1312,8 @@ _public_ struct udev_device *udev_device_ref(struct udev_device *udev_device)
  **/
 _public_ struct udev_device *udev_device_unref(struct udev_device *udev_device)
 {
+        struct udev *udev;
+
         if (udev_device == NULL)
                 return NULL;
         udev_device->refcount--;
@@ -1228,7 +1337,9 @@ _public_ struct udev_device *udev_device_unref(struct udev_device *udev_device)
         free(udev_device->id_filename);
         free(udev_device->envp);
         free(udev_device->monitor_buf);
-        free(udev_device);
+        udev = udev_device->udev;
+        udev_free(udev, udev_device, sizeof(struct udev_device));
+        udev_unref(udev);
         return NULL;
 }
 
@@ -1342,22 +1453,9 @@ void udev_device_cleanup_devlinks_list(struct udev_device *udev_device)
         udev_list_cleanup(&udev_device->devlinks_list);
 }
 
-/**
- * udev_device_get_properties_list_entry:
- * @udev_device: udev device
- *
- * Retrieve the list of key/value device properties of the udev
- * device. The next list entry can be retrieved with udev_list_entry_get_next(),
- * which returns #NULL if no more entries exist. The property name
- * can be retrieved from the list entry by udev_list_entry_get_name(),
- * the property value by udev_list_entry_get_value().
- *
- * Returns: the first entry of the property list
- **/
-_public_ struct udev_list_entry *udev_device_get_properties_list_entry(struct udev_device *udev_device)
+/* load the properties and refresh the ones composed from the devlinks and tags */
+static void udev_device_update_properties(struct udev_device *udev_device)
 {
-        if (udev_device == NULL)
-                return NULL;
         if (!udev_device->info_loaded) {
                 udev_device_read_uevent_file(udev_device);
                 udev_device_read_db(udev_device);
@@ -1396,6 +1494,25 @@ _public_ struct udev_list_entry *udev_device_get_properties_list_entry(struct ud
                         udev_device_add_property_internal(udev_device, "TAGS", NULL);
                 }
         }
+}
+
+/**
+ * udev_device_get_properties_list_entry:
+ * @udev_device: udev device
+ *
+ * Retrieve the list of key/value device properties of the udev
+ * device. The next list entry can be retrieved with udev_list_entry_get_next(),
+ * which returns #NULL if no more entries exist. The property name
+ * can be retrieved from the list entry by udev_list_entry_get_name(),
+ * the property value by udev_list_entry_get_value().
+ *
+ * Returns: the first entry of the property list
+ **/
+_public_ struct udev_list_entry *udev_device_get_properties_list_entry(struct udev_device *udev_device)
+{
+        if (udev_device == NULL)
+                return NULL;
+        udev_device_update_properties(udev_device);
         return udev_list_get_entry(&udev_device->properties_list);
 }
 
@@ -1459,30 +1576,20 @@ usec_t udev_device_get_usec_initialized(struct udev_device *udev_device)
  *
  * Returns: the content of a sys attribute file, or #NULL if there is no sys attribute value.
  **/
-_public_ const char *udev_device_get_sysattr_value(struct udev_device *udev_device, const char *sysattr)
+/* read an attribute relative to dfd and add it to the cache, a missing one only if @cache_missing is set */
+static const char *udev_device_read_sysattr(struct udev_device *udev_device, int dfd, const char *path, const char *sysattr,
+                                            bool cache_missing)
 {
         struct udev_list_entry *list_entry;
-        char path[UTIL_PATH_SIZE];
         char value[4096];
         struct stat statbuf;
         int fd;
         ssize_t size;
         const char *val = NULL;
 
-        if (udev_device == NULL)
-                return NULL;
-        if (sysattr == NULL)
-                return NULL;
-
-        /* look for possibly already cached result */
-        list_entry = udev_list_get_entry(&udev_device->sysattr_value_list);
-        list_entry = udev_list_entry_get_by_name(list_entry, sysattr);
-        if (list_entry != NULL)
-                return udev_list_entry_get_value(list_entry);
-
-        strscpyl(path, sizeof(path), udev_device_get_syspath(udev_device), "/", sysattr, NULL);
-        if (lstat(path, &statbuf) != 0) {
-                udev_list_entry_add(&udev_device->sysattr_value_list, sysattr, NULL);
+        if (fstatat(dfd, path, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+                if (cache_missing)
+                        udev_list_entry_add(&udev_device->sysattr_value_list, sysattr, NULL);
                 goto out;
         }
 
@@ -1514,7 +1621,7 @@ _public_ const char *udev_device_get_sysattr_value(struct udev_device *udev_devi
                 goto out;
 
         /* read attribute value */
-        fd = open(path, O_RDONLY|O_CLOEXEC);
+        fd = openat(dfd, path, O_RDONLY|O_CLOEXEC);
         if (fd < 0)
                 goto out;
         size = read(fd, value, sizeof(value));
@@ -1533,6 +1640,75 @@ out:
         return val;
 }
 
+_public_ const char *udev_device_get_sysattr_value(struct udev_device *udev_device, const char *sysattr)
+{
+        struct udev_list_entry *list_entry;
+        char path[UTIL_PATH_SIZE];
+
+        if (udev_device == NULL)
+                return NULL;
+        if (sysattr == NULL)
+                return NULL;
+
+        /* look for possibly already cached result */
+        list_entry = udev_list_get_entry_by_name(&udev_device->sysattr_value_list, sysattr);
+        if (list_entry != NULL)
+                return udev_list_entry_get_value(list_entry);
+
+        strscpyl(path, sizeof(path), udev_device->syspath, "/", sysattr, NULL);
+        return udev_device_read_sysattr(udev_device, AT_FDCWD, path, sysattr, true);
+}
+
+/*
+ * Read a set of attributes into the cache, relative to the device directory;
+ * later udev_device_get_sysattr_value() calls for them are served from the cache.
+ * Missing attributes are not remembered, they might still show up.
+ */
+int udev_device_read_sysattrs(struct udev_device *udev_device, char **sysattrs)
+{
+        _cleanup_close_ int dfd = -1;
+        char **sysattr;
+        int num = 0;
+
+        if (udev_device == NULL)
+                return -EINVAL;
+
+        STRV_FOREACH(sysattr, sysattrs) {
+                char buf[UTIL_PATH_SIZE];
+                const char *path;
+
+                if (udev_list_get_entry_by_name(&udev_device->sysattr_value_list, *sysattr) != NULL)
+                        continue;
+
+                if (dfd == -1)
+                        dfd = udev_device_open_syspath(udev_device);
+
+                if (dfd >= 0)
+                        path = *sysattr;
+                else {
+                        strscpyl(buf, sizeof(buf), udev_device->syspath, "/", *sysattr, NULL);
+                        path = buf;
+                }
+                if (udev_device_read_sysattr(udev_device, dfd, path, *sysattr, false) != NULL)
+                        num++;
+        }
+
+        return num;
+}
+
+/* drop the cached value of an attribute, which has been written or waited for */
+void udev_device_forget_sysattr(struct udev_device *udev_device, const char *sysattr)
+{
+        struct udev_list_entry *list_entry;
+
+        if (udev_device == NULL || sysattr == NULL)
+                return;
+
+        list_entry = udev_list_get_entry_by_name(&udev_device->sysattr_value_list, sysattr);
+        if (list_entry != NULL)
+                udev_list_entry_delete(list_entry);
+}
+
 /**
  * udev_device_set_sysattr_value:
  * @udev_device: udev device
@@ -1562,7 +1738,7 @@ _public_ int udev_device_set_sysattr_value(struct udev_device *udev_device, cons
         else
                 value_len = strlen(value);
 
-        strscpyl(path, sizeof(path), udev_device_get_syspath(dev), "/", sysattr, NULL);
+        strscpyl(path, sizeof(path), dev->syspath, "/", sysattr, NULL);
         if (lstat(path, &statbuf) != 0) {
                 udev_list_entry_add(&dev->sysattr_value_list, sysattr, NULL);
                 ret = -ENXIO;
@@ -1634,18 +1810,19 @@ static int udev_device_sysattr_list_read(struct udev_device *udev_device)
                 return -errno;
 
         for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
-                char path[UTIL_PATH_SIZE];
                 struct stat statbuf;
 
                 /* only handle symlinks and regular files */
                 if (dent->d_type != DT_LNK && dent->d_type != DT_REG)
                         continue;
 
-                strscpyl(path, sizeof(path), udev_device_get_syspath(udev_device), "/", dent->d_name, NULL);
-                if (lstat(path, &statbuf) != 0)
-                        continue;
-                if ((statbuf.st_mode & S_IRUSR) == 0)
-                        continue;
+                /* the mode of a symlink is always 0777, only files can be unreadable */
+                if (dent->d_type == DT_REG) {
+                        if (fstatat(dirfd(dir), dent->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) != 0)
+                                continue;
+                        if ((statbuf.st_mode & S_IRUSR) == 0)
+                                continue;
+                }
 
                 udev_list_entry_add(&udev_device->sysattr_list, dent->d_name, NULL);
                 num++;
@@ -1785,8 +1962,7 @@ void udev_device_remove_tag(struct udev_device *udev_device, const char *tag)
 
         if (!is_valid_tag(tag))
                 return;
-        e = udev_list_get_entry(&udev_device->tags_list);
-        e = udev_list_entry_get_by_name(e, tag);
+        e = udev_list_get_entry_by_name(&udev_device->tags_list, tag);
         if (e) {
                 udev_device->tags_uptodate = false;
                 udev_list_entry_delete(e);
@@ -1830,14 +2006,11 @@ _public_ struct udev_list_entry *udev_device_get_tags_list_entry(struct udev_dev
  **/
 _public_ int udev_device_has_tag(struct udev_device *udev_device, const char *tag)
 {
-        struct udev_list_entry *list_entry;
-
         if (udev_device == NULL)
                 return false;
         if (!udev_device->info_loaded)
                 udev_device_read_db(udev_device);
-        list_entry = udev_device_get_tags_list_entry(udev_device);
-        if (udev_list_entry_get_by_name(list_entry, tag) != NULL)
+        if (udev_list_get_entry_by_name(&udev_device->tags_list, tag) != NULL)
                 return true;
         return false;
 }
@@ -26,12 +26,15 @@
 #include <dirent.h>
 #include <fnmatch.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/param.h>
 #include <sys/sysmacros.h>
 
 #include "libudev.h"
 #include "libudev-private.h"
+#include "set.h"
+#include "strv.h"
 
 /**
  * SECTION:libudev-enumerate
@@ -68,6 +71,12 @@ struct udev_enumerate {
         unsigned int devices_max;
         bool devices_uptodate:1;
         bool match_is_initialized;
+        unsigned int scan_threads;
+        /* set while devices are passed to a callback instead of being collected */
+        int (*stream_cb)(struct udev_enumerate *udev_enumerate, struct udev_device *udev_device, void *userdata);
+        void *stream_userdata;
+        Set *stream_seen;
+        int stream_r;
 };
 
 /**
@@ -196,6 +205,33 @@ static int syspath_add(struct udev_enumerate *udev_enumerate, const char *syspat
         return 0;
 }
 
+/* collect a matching device, or pass it to the callback of a streaming scan */
+static int device_add(struct udev_enumerate *udev_enumerate, struct udev_device *dev)
+{
+        int r;
+
+        if (udev_enumerate->stream_cb == NULL)
+                return syspath_add(udev_enumerate, udev_device_get_syspath(dev));
+
+        if (udev_enumerate->stream_seen != NULL) {
+                char *path;
+
+                path = strdup(udev_device_get_syspath(dev));
+                if (path == NULL)
+                        return -ENOMEM;
+                r = set_consume(udev_enumerate->stream_seen, path);
+                if (r == 0)
+                        return 0;
+                if (r < 0)
+                        return r;
+        }
+
+        r = udev_enumerate->stream_cb(udev_enumerate, dev, udev_enumerate->stream_userdata);
+        if (r < 0)
+                udev_enumerate->stream_r = r;
+        return r;
+}
+
 static int syspath_cmp(const void *p1, const void *p2)
 {
         const struct syspath *path1 = p1;
@@ -653,6 +689,34 @@ static bool match_sysname(struct udev_enumerate *udev_enumerate, const char *sys
         return false;
 }
 
+static bool match_scanned_device(struct udev_enumerate *udev_enumerate, struct udev_device *dev)
+{
+        if (udev_enumerate->match_is_initialized) {
+                /*
+                 * All devices with a device node or network interfaces
+                 * possibly need udev to adjust the device node permission
+                 * or context, or rename the interface before it can be
+                 * reliably used from other processes.
+                 *
+                 * For now, we can only check these types of devices, we
+                 * might not store a database, and have no way to find out
+                 * for all other types of devices.
+                 */
+                if (!udev_device_get_is_initialized(dev) &&
+                    (major(udev_device_get_devnum(dev)) > 0 || udev_device_get_ifindex(dev) > 0))
+                        return false;
+        }
+        if (!match_parent(udev_enumerate, dev))
+                return false;
+        if (!match_tag(udev_enumerate, dev))
+                return false;
+        if (!match_property(udev_enumerate, dev))
+                return false;
+        if (!match_sysattr(udev_enumerate, dev))
+                return false;
+        return true;
+}
+
 static int scan_dir_and_add_devices(struct udev_enumerate *udev_enumerate,
                                     const char *basedir, const char *subdir1, const char *subdir2)
 {
@@ -686,33 +750,12 @@ static int scan_dir_and_add_devices(struct udev_enumerate *udev_enumerate,
                 if (dev == NULL)
                         continue;
 
-                if (udev_enumerate->match_is_initialized) {
-                        /*
-                         * All devices with a device node or network interfaces
-                         * possibly need udev to adjust the device node permission
-                         * or context, or rename the interface before it can be
-                         * reliably used from other processes.
-                         *
-                         * For now, we can only check these types of devices, we
-                         * might not store a database, and have no way to find out
-                         * for all other types of devices.
-                         */
-                        if (!udev_device_get_is_initialized(dev) &&
-                            (major(udev_device_get_devnum(dev)) > 0 || udev_device_get_ifindex(dev) > 0))
-                                goto nomatch;
-                }
-                if (!match_parent(udev_enumerate, dev))
-                        goto nomatch;
-                if (!match_tag(udev_enumerate, dev))
-                        goto nomatch;
-                if (!match_property(udev_enumerate, dev))
-                        goto nomatch;
-                if (!match_sysattr(udev_enumerate, dev))
-                        goto nomatch;
-
-                syspath_add(udev_enumerate, udev_device_get_syspath(dev));
-nomatch:
+                if (match_scanned_device(udev_enumerate, dev))
+                        device_add(udev_enumerate, dev);
+
                 udev_device_unref(dev);
+                if (udev_enumerate->stream_r < 0)
+                        break;
         }
         closedir(dir);
         return 0;
@@ -757,6 +800,8 @@ static int scan_dir(struct udev_enumerate *udev_enumerate, const char *basedir,
                 if (!match_subsystem(udev_enumerate, subsystem != NULL ? subsystem : dent->d_name))
                         continue;
                 scan_dir_and_add_devices(udev_enumerate, basedir, dent->d_name, subdir);
+                if (udev_enumerate->stream_r < 0)
+                        break;
         }
         closedir(dir);
         return 0;
@@ -788,6 +833,80 @@ _public_ int udev_enumerate_add_syspath(struct udev_enumerate *udev_enumerate, c
         return 0;
 }
 
+/* the devices of the index match, if only their subsystem and sysname are matched */
+static bool match_index_entry_only(struct udev_enumerate *udev_enumerate)
+{
+        return udev_enumerate->stream_cb == NULL &&
+               udev_enumerate->parent_match == NULL &&
+               udev_list_get_entry(&udev_enumerate->properties_match_list) == NULL &&
+               udev_list_get_entry(&udev_enumerate->sysattr_match_list) == NULL &&
+               udev_list_get_entry(&udev_enumerate->sysattr_nomatch_list) == NULL;
+}
+
+/* find the devices of a tag in its index file, returns -ENOENT if udevd does not maintain one */
+static int scan_devices_tag_index(struct udev_enumerate *udev_enumerate, const char *tag)
+{
+        _cleanup_tag_index_free_ struct tag_index *index = NULL;
+        bool entry_only;
+        size_t i;
+        int r;
+
+        r = tag_index_load(tag, &index);
+        if (r < 0)
+                return r;
+
+        entry_only = match_index_entry_only(udev_enumerate);
+
+        for (i = 0; i < index->entries_count; i++) {
+                const struct tag_index_entry *e = &index->entries[i];
+                char sysname[UTIL_NAME_SIZE];
+                char syspath[UTIL_PATH_SIZE];
+                struct udev_device *dev = NULL;
+                bool exists;
+                char *s;
+
+                if (!match_subsystem(udev_enumerate, e->subsystem))
+                        continue;
+
+                /* some devices have '!' in their name, change that to '/' */
+                strscpy(sysname, sizeof(sysname), strrchr(e->devpath, '/') + 1);
+                for (s = sysname; *s != '\0'; s++)
+                        if (*s == '!')
+                                *s = '/';
+                if (!match_sysname(udev_enumerate, sysname))
+                        continue;
+
+                strscpyl(syspath, sizeof(syspath), "/sys", e->devpath, NULL);
+                exists = access(syspath, F_OK) >= 0;
+                if (exists && entry_only) {
+                        r = syspath_add(udev_enumerate, syspath);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                /*
+                 * The devpath of a device changes without an event of its own,
+                 * when a parent device is moved; the id does not.
+                 */
+                if (exists)
+                        dev = udev_device_new_from_syspath(udev_enumerate->udev, syspath);
+                if (dev == NULL)
+                        dev = udev_device_new_from_device_id(udev_enumerate->udev, e->id);
+                if (dev == NULL)
+                        continue;
+                if (match_parent(udev_enumerate, dev) &&
+                    match_property(udev_enumerate, dev) &&
+                    match_sysattr(udev_enumerate, dev))
+                        device_add(udev_enumerate, dev);
+                udev_device_unref(dev);
+                if (udev_enumerate->stream_r < 0)
+                        break;
+        }
+
+        return 0;
+}
+
 static int scan_devices_tags(struct udev_enumerate *udev_enumerate)
 {
         struct udev_list_entry *list_entry;
@@ -797,6 +916,16 @@ static int scan_devices_tags(struct udev_enumerate *udev_enumerate)
                 DIR *dir;
                 struct dirent *dent;
                 char path[UTIL_PATH_SIZE];
+                int r;
+
+                r = scan_devices_tag_index(udev_enumerate, udev_list_entry_get_name(list_entry));
+                if (r != -ENOENT) {
+                        if (r < 0)
+                                return r;
+                        if (udev_enumerate->stream_r < 0)
+                                break;
+                        continue;
+                }
 
                 strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/tags/", udev_list_entry_get_name(list_entry), NULL);
                 dir = opendir(path);
@@ -823,11 +952,92 @@ static int scan_devices_tags(struct udev_enumerate *udev_enumerate)
                         if (!match_sysattr(udev_enumerate, dev))
                                 goto nomatch;
 
-                        syspath_add(udev_enumerate, udev_device_get_syspath(dev));
+                        device_add(udev_enumerate, dev);
 nomatch:
                         udev_device_unref(dev);
+                        if (udev_enumerate->stream_r < 0)
+                                break;
                 }
                 closedir(dir);
+                if (udev_enumerate->stream_r < 0)
+                        break;
+        }
+        return 0;
+}
+
+/* all property matches are exact and udevd has indexed all devices by their keys */
+static bool properties_indexed(struct udev_enumerate *udev_enumerate)
+{
+        struct udev_list_entry *list_entry;
+
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_enumerate->properties_match_list)) {
+                const char *key = udev_list_entry_get_name(list_entry);
+                const char *value = udev_list_entry_get_value(list_entry);
+                char value_enc[NAME_MAX+1];
+                char path[UTIL_PATH_SIZE];
+
+                if (value == NULL || string_is_glob(key) || string_is_glob(value))
+                        return false;
+                if (key[0] == '.' || strchr(key, '/') != NULL)
+                        return false;
+                /* values too long for the index are not in it */
+                if (util_property_index_encode(value, value_enc, sizeof(value_enc)) < 0)
+                        return false;
+                strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/property/.indexed/", key, NULL);
+                if (access(path, F_OK) < 0)
+                        return false;
+        }
+        return true;
+}
+
+static int scan_devices_properties(struct udev_enumerate *udev_enumerate)
+{
+        struct udev_list_entry *list_entry;
+
+        /* scan only devices with the property, use the property reverse-index maintained by udevd */
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_enumerate->properties_match_list)) {
+                DIR *dir;
+                struct dirent *dent;
+                char value_enc[NAME_MAX+1];
+                char path[UTIL_PATH_SIZE];
+
+                util_property_index_encode(udev_list_entry_get_value(list_entry), value_enc, sizeof(value_enc));
+                strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/property/",
+                         udev_list_entry_get_name(list_entry), "/", value_enc, NULL);
+                dir = opendir(path);
+                if (dir == NULL)
+                        continue;
+                for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                        struct udev_device *dev;
+
+                        if (dent->d_name[0] == '.')
+                                continue;
+
+                        dev = udev_device_new_from_device_id(udev_enumerate->udev, dent->d_name);
+                        if (dev == NULL)
+                                continue;
+
+                        if (!match_subsystem(udev_enumerate, udev_device_get_subsystem(dev)))
+                                goto nomatch;
+                        if (!match_sysname(udev_enumerate, udev_device_get_sysname(dev)))
+                                goto nomatch;
+                        if (!match_parent(udev_enumerate, dev))
+                                goto nomatch;
+                        /* the index entry might be stale */
+                        if (!match_property(udev_enumerate, dev))
+                                goto nomatch;
+                        if (!match_sysattr(udev_enumerate, dev))
+                                goto nomatch;
+
+                        device_add(udev_enumerate, dev);
+nomatch:
+                        udev_device_unref(dev);
+                        if (udev_enumerate->stream_r < 0)
+                                break;
+                }
+                closedir(dir);
+                if (udev_enumerate->stream_r < 0)
+                        break;
         }
         return 0;
 }
@@ -850,7 +1060,7 @@ static int parent_add_child(struct udev_enumerate *enumerate, const char *path)
         if (!match_sysattr(enumerate, dev))
                 goto nomatch;
 
-        syspath_add(enumerate, udev_device_get_syspath(dev));
+        device_add(enumerate, dev);
         r = 1;
 
 nomatch:
@@ -880,6 +1090,8 @@ static int parent_crawl_children(struct udev_enumerate *enumerate, const char *p
                 if (maxdepth > 0)
                         parent_crawl_children(enumerate, child, maxdepth-1);
                 free(child);
+                if (enumerate->stream_r < 0)
+                        break;
         }
 
         closedir(d);
@@ -892,18 +1104,205 @@ static int scan_devices_children(struct udev_enumerate *enumerate)
 
         path = udev_device_get_syspath(enumerate->parent_match);
         parent_add_child(enumerate, path);
+        if (enumerate->stream_r < 0)
+                return 0;
         return parent_crawl_children(enumerate, path, 256);
 }
 
+/*
+ * Parallel scan: the subsystem directories are distributed over a few
+ * threads. libudev objects are not thread-safe, so every thread creates
+ * the devices in its own udev context and only hands back the syspaths
+ * of the matching devices, which are merged into the enumeration list,
+ * and sorted with it, after all threads are done.
+ */
+struct scan_pool {
+        struct udev_enumerate *udev_enumerate;
+        char **dirs;
+        unsigned int n_dirs;
+        unsigned int next;
+};
+
+struct scan_worker {
+        struct scan_pool *pool;
+        struct udev *udev;
+        pthread_t thread;
+        char **syspaths;
+        size_t n_syspaths;
+        size_t allocated;
+};
+
+static void scan_worker_dir(struct scan_worker *worker, const char *path)
+{
+        struct udev_enumerate *udev_enumerate = worker->pool->udev_enumerate;
+        DIR *dir;
+        struct dirent *dent;
+
+        dir = opendir(path);
+        if (dir == NULL)
+                return;
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                char syspath[UTIL_PATH_SIZE];
+                struct udev_device *dev;
+                char *p;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                if (!match_sysname(udev_enumerate, dent->d_name))
+                        continue;
+
+                strscpyl(syspath, sizeof(syspath), path, "/", dent->d_name, NULL);
+                dev = udev_device_new_from_syspath(worker->udev, syspath);
+                if (dev == NULL)
+                        continue;
+
+                if (match_scanned_device(udev_enumerate, dev) &&
+                    GREEDY_REALLOC(worker->syspaths, worker->allocated, worker->n_syspaths + 1)) {
+                        p = strdup(udev_device_get_syspath(dev));
+                        if (p != NULL)
+                                worker->syspaths[worker->n_syspaths++] = p;
+                }
+
+                udev_device_unref(dev);
+        }
+        closedir(dir);
+}
+
+static void *scan_worker_run(void *userdata)
+{
+        struct scan_worker *worker = userdata;
+        struct scan_pool *pool = worker->pool;
+
+        for (;;) {
+                unsigned int i;
+
+                i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+                if (i >= pool->n_dirs)
+                        break;
+                scan_worker_dir(worker, pool->dirs[i]);
+        }
+
+        return NULL;
+}
+
+static int scan_dir_collect(struct udev_enumerate *udev_enumerate, const char *basedir, const char *subdir, char ***dirs)
+{
+        char path[UTIL_PATH_SIZE];
+        DIR *dir;
+        struct dirent *dent;
+
+        strscpyl(path, sizeof(path), "/sys/", basedir, NULL);
+        dir = opendir(path);
+        if (dir == NULL)
+                return -errno;
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                char *p;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+                if (!match_subsystem(udev_enumerate, dent->d_name))
+                        continue;
+                if (subdir != NULL)
+                        p = strjoin(path, "/", dent->d_name, "/", subdir, NULL);
+                else
+                        p = strjoin(path, "/", dent->d_name, NULL);
+                if (p == NULL || strv_consume(dirs, p) < 0) {
+                        closedir(dir);
+                        return -ENOMEM;
+                }
+        }
+        closedir(dir);
+        return 0;
+}
+
+static int scan_devices_all_parallel(struct udev_enumerate *udev_enumerate, const char **basedirs, const char **subdirs)
+{
+        _cleanup_strv_free_ char **dirs = NULL;
+        struct scan_pool pool = {};
+        struct scan_worker *workers;
+        unsigned int n_workers, i;
+        size_t j;
+        int r;
+
+        for (i = 0; basedirs[i] != NULL; i++) {
+                r = scan_dir_collect(udev_enumerate, basedirs[i], subdirs[i], &dirs);
+                if (r == -ENOMEM)
+                        return r;
+        }
+
+        pool.udev_enumerate = udev_enumerate;
+        pool.dirs = dirs;
+        pool.n_dirs = strv_length(dirs);
+
+        n_workers = MIN(udev_enumerate->scan_threads, pool.n_dirs);
+        if (n_workers == 0)
+                return 0;
+        workers = new0(struct scan_worker, n_workers);
+        if (workers == NULL)
+                return -ENOMEM;
+
+        /* the match lists are sorted lazily, do it before they are shared */
+        udev_list_get_entry(&udev_enumerate->sysattr_match_list);
+        udev_list_get_entry(&udev_enumerate->sysattr_nomatch_list);
+        udev_list_get_entry(&udev_enumerate->sysname_match_list);
+        udev_list_get_entry(&udev_enumerate->properties_match_list);
+        udev_list_get_entry(&udev_enumerate->tags_match_list);
+
+        /* the calling thread takes part with the enumeration's own context */
+        workers[0].pool = &pool;
+        workers[0].udev = udev_enumerate->udev;
+        for (i = 1; i < n_workers; i++) {
+                workers[i].pool = &pool;
+                workers[i].udev = udev_new();
+                if (workers[i].udev == NULL)
+                        break;
+                if (pthread_create(&workers[i].thread, NULL, scan_worker_run, &workers[i]) != 0) {
+                        workers[i].udev = udev_unref(workers[i].udev);
+                        break;
+                }
+        }
+
+        scan_worker_run(&workers[0]);
+
+        for (i = 0; i < n_workers; i++) {
+                if (i > 0 && workers[i].udev != NULL) {
+                        pthread_join(workers[i].thread, NULL);
+                        udev_unref(workers[i].udev);
+                }
+                for (j = 0; j < workers[i].n_syspaths; j++) {
+                        syspath_add(udev_enumerate, workers[i].syspaths[j]);
+                        free(workers[i].syspaths[j]);
+                }
+                free(workers[i].syspaths);
+        }
+        free(workers);
+
+        return 0;
+}
+
 static int scan_devices_all(struct udev_enumerate *udev_enumerate)
 {
         struct stat statbuf;
 
+        if (udev_enumerate->scan_threads > 1 && udev_enumerate->stream_cb == NULL) {
+                static const char *subsystem_dirs[] = { "subsystem", NULL };
+                static const char *subsystem_subdirs[] = { "devices" };
+                static const char *bus_class_dirs[] = { "bus", "class", NULL };
+                static const char *bus_class_subdirs[] = { "devices", NULL };
+
+                if (stat("/sys/subsystem", &statbuf) == 0)
+                        return scan_devices_all_parallel(udev_enumerate, subsystem_dirs, subsystem_subdirs);
+                return scan_devices_all_parallel(udev_enumerate, bus_class_dirs, bus_class_subdirs);
+        }
+
         if (stat("/sys/subsystem", &statbuf) == 0) {
                 /* we have /subsystem/, forget all the old stuff */
                 scan_dir(udev_enumerate, "subsystem", "devices", NULL);
         } else {
                 scan_dir(udev_enumerate, "bus", "devices", NULL);
+                if (udev_enumerate->stream_r < 0)
+                        return 0;
                 scan_dir(udev_enumerate, "class", NULL, NULL);
         }
         return 0;
@@ -927,6 +1326,11 @@ _public_ int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate)
         if (udev_list_get_entry(&udev_enumerate->tags_match_list) != NULL)
                 return scan_devices_tags(udev_enumerate);
 
+        /* exact property matches of indexed keys, udevd maintains a reverse-index */
+        if (udev_list_get_entry(&udev_enumerate->properties_match_list) != NULL &&
+            properties_indexed(udev_enumerate))
+                return scan_devices_properties(udev_enumerate);
+
         /* walk the subtree of one parent device only */
         if (udev_enumerate->parent_match != NULL)
                 return scan_devices_children(udev_enumerate);
@@ -935,6 +1339,90 @@ _public_ int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate)
         return scan_devices_all(udev_enumerate);
 }
 
+/**
+ * udev_enumerate_set_scan_threads:
+ * @udev_enumerate: udev enumeration context
+ * @n_threads: number of threads
+ *
+ * Let udev_enumerate_scan_devices() scan the devices of all subsystems
+ * with up to @n_threads threads, including the calling one. The
+ * resulting list is the same as the one of a sequential scan. Scans
+ * restricted by tags or a parent device, and streaming scans, are not
+ * parallelized. A value of 0 or 1 disables the parallel scan, which
+ * is the default.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ **/
+_public_ int udev_enumerate_set_scan_threads(struct udev_enumerate *udev_enumerate, unsigned int n_threads)
+{
+        if (udev_enumerate == NULL)
+                return -EINVAL;
+        udev_enumerate->scan_threads = MIN(n_threads, 64U);
+        return 0;
+}
+
+/**
+ * udev_enumerate_scan_devices_stream:
+ * @udev_enumerate: udev enumeration context
+ * @cb: function called for every matching device
+ * @userdata: data passed to @cb
+ *
+ * Scan /sys for all devices which match the given filters, like
+ * udev_enumerate_scan_devices(), but pass every matching device to
+ * @cb as soon as it is found, instead of collecting and sorting the
+ * list. The devices are passed in the order they are found in sysfs.
+ * The device is only valid during the call, @cb needs to take a
+ * reference to keep it. If @cb returns a negative value, the scan
+ * stops and the value is returned. The device list of the enumeration
+ * context is not changed.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ **/
+_public_ int udev_enumerate_scan_devices_stream(struct udev_enumerate *udev_enumerate,
+                                                int (*cb)(struct udev_enumerate *udev_enumerate,
+                                                          struct udev_device *udev_device,
+                                                          void *userdata),
+                                                void *userdata)
+{
+        struct udev_list_entry *list_entry;
+        unsigned int n_tags = 0;
+        unsigned int n_properties = 0;
+        int r;
+
+        if (udev_enumerate == NULL || cb == NULL)
+                return -EINVAL;
+
+        /*
+         * a device tagged with more than one of the matched tags, or carrying
+         * more than one of the matched properties, is found more than once
+         */
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_enumerate->tags_match_list))
+                n_tags++;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_enumerate->properties_match_list))
+                n_properties++;
+        if (n_tags > 1 || (n_tags == 0 && n_properties > 1)) {
+                udev_enumerate->stream_seen = set_new(&string_hash_ops);
+                if (udev_enumerate->stream_seen == NULL)
+                        return -ENOMEM;
+        }
+
+        udev_enumerate->stream_cb = cb;
+        udev_enumerate->stream_userdata = userdata;
+        udev_enumerate->stream_r = 0;
+
+        r = udev_enumerate_scan_devices(udev_enumerate);
+        if (r >= 0)
+                r = udev_enumerate->stream_r;
+
+        udev_enumerate->stream_cb = NULL;
+        udev_enumerate->stream_userdata = NULL;
+        udev_enumerate->stream_r = 0;
+        set_free_free(udev_enumerate->stream_seen);
+        udev_enumerate->stream_seen = NULL;
+
+        return r;
+}
+
 /**
  * udev_enumerate_scan_subsystems:
  * @udev_enumerate: udev enumeration context
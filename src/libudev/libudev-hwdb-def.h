@@ -43,6 +43,10 @@ struct trie_header_f {
         /* size of the nodes and string section */
         le64_t nodes_len;
         le64_t strings_len;
+
+        /* hash of the source files, to skip rebuilding an unchanged database;
+         * not present if header_size is smaller, readers use absolute offsets */
+        uint8_t sources_hash[8];
 } _packed_;
 
 struct trie_node_f {
@@ -69,3 +73,94 @@ struct trie_value_entry_f {
         le64_t key_off;
         le64_t value_off;
 } _packed_;
+
+/*
+ * Version 2 of the on-disk trie, smaller and faster to search, written
+ * only with udevadm hwdb --format=2. All offsets are 32 bit, relative to
+ * the start of the file. Readers recognize the version by the signature.
+ */
+#define HWDB_SIG_V2 { 'K', 'S', 'L', 'P', 'H', 'H', 'R', '2' }
+
+struct trie_header_f2 {
+        uint8_t signature[8];
+
+        /* version of tool which created the file */
+        le64_t tool_version;
+        le64_t file_size;
+
+        /* size of structures to allow them to grow */
+        le32_t header_size;
+        le32_t node_size;
+        le32_t value_entry_size;
+
+        /* offset of the root trie node */
+        le32_t nodes_root_off;
+
+        /* size of the nodes and string section */
+        le32_t nodes_len;
+        le32_t strings_len;
+
+        /* glob index, follows the string section; not present if header_size is smaller */
+        le32_t glob_group_size;
+        le32_t glob_entry_size;
+        le32_t globs_off;
+        le32_t globs_count;
+
+        /* hash of the source files, to skip rebuilding an unchanged database */
+        uint8_t sources_hash[8];
+} _packed_;
+
+/* the children are a direct-index table of child offsets */
+#define TRIE_NODE_F2_DIRECT 0x01
+
+/*
+ * A node is followed by its children and its value entries.
+ *
+ * Sorted children:
+ *   uint8_t keys[children_count]
+ *   le32_t child_off[children_count]
+ *
+ * Direct-index children (TRIE_NODE_F2_DIRECT), for nodes with many children:
+ *   uint8_t first, uint8_t slots
+ *   le32_t child_off[slots], for the characters first to first+slots-1, 0 if missing
+ */
+struct trie_node_f2 {
+        /* prefix of lookup string, shared by all children  */
+        le32_t prefix_off;
+        /* size of value entry array */
+        le32_t values_count;
+        /* number of children */
+        uint8_t children_count;
+        uint8_t flags;
+} _packed_;
+
+struct trie_value_entry_f2 {
+        le32_t key_off;
+        le32_t value_off;
+} _packed_;
+
+/*
+ * The glob index lists all matches which contain a wildcard. The matches
+ * are grouped by the trie node where the search reaches the first wildcard,
+ * that is by their literal prefix. A search which passes such a node only
+ * needs to match the entries of its group, instead of walking the subtree
+ * below the wildcard. Nodes with only a few matches may have no group.
+ *
+ * The groups are sorted by node offset. The entries of a group are in trie
+ * order, and their patterns start at the first wildcard.
+ */
+struct trie_glob_group_f2 {
+        le32_t node_off;
+        le32_t entries_off;
+        le32_t entries_count;
+} _packed_;
+
+/* the pattern contains no other wildcard than '*' */
+#define TRIE_GLOB_F2_STAR 0x01
+
+struct trie_glob_entry_f2 {
+        le32_t pattern_off;
+        /* node carrying the values of the match */
+        le32_t node_off;
+        uint8_t flags;
+} _packed_;
@@ -43,6 +43,16 @@
  *
  * Opaque object representing the hardware database.
  */
+/* number of retrieved properties, which are checked for duplicates right away */
+#define HWDB_PROPERTIES_SCAN_MAX 16
+
+struct hwdb_property {
+        const char *name;
+        const char *value;
+        /* position in the lookup, a later one overrides an earlier one */
+        size_t order;
+};
+
 struct udev_hwdb {
         struct udev *udev;
         int refcount;
@@ -51,12 +61,37 @@ struct udev_hwdb {
         struct stat st;
         union {
                 struct trie_header_f *head;
+                struct trie_header_f2 *head2;
                 const char *map;
         };
 
+        /* format version of the mapped file, and its record sizes */
+        unsigned int version;
+        uint64_t nodes_root_off;
+        size_t node_size;
+        size_t child_entry_size;
+        size_t value_entry_size;
+
+        /* glob index of version 2 files */
+        uint64_t globs_off;
+        size_t globs_count;
+        size_t glob_group_size;
+        size_t glob_entry_size;
+
+        /* trie nodes read by the last lookup */
+        uint64_t nodes_visited;
+
+        /* properties retrieved by the last lookup, pointing into the mapped file */
+        struct hwdb_property *properties;
+        size_t properties_count;
+        size_t properties_allocated;
+        bool properties_dups;
+
+        /* copy of the properties, for udev_hwdb_get_properties_list_entry() */
         struct udev_list properties_list;
 };
 
+
 struct linebuf {
         char bytes[LINE_MAX];
         size_t size;
@@ -100,24 +135,104 @@ static void linebuf_rem_char(struct linebuf *buf) {
         linebuf_rem(buf, 1);
 }
 
-static const struct trie_child_entry_f *trie_node_children(struct udev_hwdb *hwdb, const struct trie_node_f *node) {
-        return (const struct trie_child_entry_f *)((const char *)node + le64toh(hwdb->head->node_size));
+static uint32_t read_le32(const void *p) {
+        le32_t v;
+
+        memcpy(&v, p, sizeof(v));
+        return le32toh(v);
+}
+
+static const void *trie_node_from_off(struct udev_hwdb *hwdb, uint64_t off) {
+        return hwdb->map + off;
+}
+
+static const char *trie_string(struct udev_hwdb *hwdb, uint64_t off) {
+        return hwdb->map + off;
+}
+
+static const char *trie_node_prefix(struct udev_hwdb *hwdb, const void *node) {
+        if (hwdb->version >= 2)
+                return trie_string(hwdb, le32toh(((const struct trie_node_f2 *)node)->prefix_off));
+        return trie_string(hwdb, le64toh(((const struct trie_node_f *)node)->prefix_off));
+}
+
+static uint64_t trie_node_values_count(struct udev_hwdb *hwdb, const void *node) {
+        if (hwdb->version >= 2)
+                return le32toh(((const struct trie_node_f2 *)node)->values_count);
+        return le64toh(((const struct trie_node_f *)node)->values_count);
 }
 
-static const struct trie_value_entry_f *trie_node_values(struct udev_hwdb *hwdb, const struct trie_node_f *node) {
-        const char *base = (const char *)node;
+/* the children of a version 2 node, directly behind the node record */
+static const uint8_t *trie_node_children_f2(struct udev_hwdb *hwdb, const void *node) {
+        return (const uint8_t *)node + hwdb->node_size;
+}
 
-        base += le64toh(hwdb->head->node_size);
-        base += node->children_count * le64toh(hwdb->head->child_entry_size);
-        return (const struct trie_value_entry_f *)base;
+static bool trie_node_is_direct_f2(const void *node) {
+        return ((const struct trie_node_f2 *)node)->flags & TRIE_NODE_F2_DIRECT;
 }
 
-static const struct trie_node_f *trie_node_from_off(struct udev_hwdb *hwdb, le64_t off) {
-        return (const struct trie_node_f *)(hwdb->map + le64toh(off));
+/* number of child slots, of which some might be empty in a direct-index table */
+static size_t trie_node_child_slots(struct udev_hwdb *hwdb, const void *node) {
+        if (hwdb->version >= 2) {
+                if (((const struct trie_node_f2 *)node)->children_count == 0)
+                        return 0;
+                if (trie_node_is_direct_f2(node))
+                        return trie_node_children_f2(hwdb, node)[1];
+                return ((const struct trie_node_f2 *)node)->children_count;
+        }
+        return ((const struct trie_node_f *)node)->children_count;
 }
 
-static const char *trie_string(struct udev_hwdb *hwdb, le64_t off) {
-        return hwdb->map + le64toh(off);
+static const void *trie_node_child(struct udev_hwdb *hwdb, const void *node, size_t i, uint8_t *c) {
+        if (hwdb->version >= 2) {
+                const uint8_t *children = trie_node_children_f2(hwdb, node);
+                size_t count = ((const struct trie_node_f2 *)node)->children_count;
+                uint32_t off;
+
+                if (trie_node_is_direct_f2(node)) {
+                        off = read_le32(children + 2 + i * sizeof(le32_t));
+                        if (off == 0)
+                                return NULL;
+                        *c = children[0] + i;
+                } else {
+                        off = read_le32(children + count + i * sizeof(le32_t));
+                        *c = children[i];
+                }
+                return trie_node_from_off(hwdb, off);
+        } else {
+                const struct trie_child_entry_f *child;
+
+                child = (const struct trie_child_entry_f *)((const char *)node + hwdb->node_size +
+                                                            i * hwdb->child_entry_size);
+                *c = child->c;
+                return trie_node_from_off(hwdb, le64toh(child->child_off));
+        }
+}
+
+static void trie_node_value(struct udev_hwdb *hwdb, const void *node, size_t i,
+                            const char **key, const char **value) {
+        const char *base = (const char *)node + hwdb->node_size;
+
+        if (hwdb->version >= 2) {
+                const struct trie_value_entry_f2 *v;
+
+                if (((const struct trie_node_f2 *)node)->children_count > 0) {
+                        if (trie_node_is_direct_f2(node))
+                                base += 2 + trie_node_children_f2(hwdb, node)[1] * sizeof(le32_t);
+                        else
+                                base += ((const struct trie_node_f2 *)node)->children_count * (1 + sizeof(le32_t));
+                }
+                v = (const struct trie_value_entry_f2 *)(base + i * hwdb->value_entry_size);
+                *key = trie_string(hwdb, le32toh(v->key_off));
+                *value = trie_string(hwdb, le32toh(v->value_off));
+        } else {
+                const struct trie_value_entry_f *v;
+
+                base += ((const struct trie_node_f *)node)->children_count * hwdb->child_entry_size;
+                v = (const struct trie_value_entry_f *)(base + i * hwdb->value_entry_size);
+                *key = trie_string(hwdb, le64toh(v->key_off));
+                *value = trie_string(hwdb, le64toh(v->value_off));
+        }
 }
 
 static int trie_children_cmp_f(const void *v1, const void *v2) {
@@ -127,56 +242,133 @@ static int trie_children_cmp_f(const void *v1, const void *v2) {
         return n1->c - n2->c;
 }
 
-static const struct trie_node_f *node_lookup_f(struct udev_hwdb *hwdb, const struct trie_node_f *node, uint8_t c) {
+static const void *node_lookup_f(struct udev_hwdb *hwdb, const void *node, uint8_t c) {
         struct trie_child_entry_f *child;
         struct trie_child_entry_f search;
 
+        if (hwdb->version >= 2) {
+                const uint8_t *children = trie_node_children_f2(hwdb, node);
+                size_t count = ((const struct trie_node_f2 *)node)->children_count;
+                const uint8_t *key;
+                uint32_t off;
+
+                if (count == 0)
+                        return NULL;
+
+                if (trie_node_is_direct_f2(node)) {
+                        if (c < children[0] || c - children[0] >= children[1])
+                                return NULL;
+                        off = read_le32(children + 2 + (c - children[0]) * sizeof(le32_t));
+                        if (off == 0)
+                                return NULL;
+                        return trie_node_from_off(hwdb, off);
+                }
+
+                /* the keys are packed, to be scanned with few cache line loads */
+                key = memchr(children, c, count);
+                if (!key)
+                        return NULL;
+                return trie_node_from_off(hwdb, read_le32(children + count + (key - children) * sizeof(le32_t)));
+        }
+
         search.c = c;
-        child = bsearch(&search, trie_node_children(hwdb, node), node->children_count,
-                        le64toh(hwdb->head->child_entry_size), trie_children_cmp_f);
+        child = bsearch(&search, (const char *)node + hwdb->node_size, ((const struct trie_node_f *)node)->children_count,
+                        hwdb->child_entry_size, trie_children_cmp_f);
         if (child)
-                return trie_node_from_off(hwdb, child->child_off);
+                return trie_node_from_off(hwdb, le64toh(child->child_off));
         return NULL;
 }
 
 static int hwdb_add_property(struct udev_hwdb *hwdb, const char *key, const char *value) {
+        size_t i;
+
         /*
          * Silently ignore all properties which do not start with a
          * space; future extensions might use additional prefixes.
          */
         if (key[0] != ' ')
                 return 0;
+        key++;
+
+        /*
+         * A later match overrides the value of an earlier one. Lookups
+         * usually retrieve a few properties, which are searched right
+         * away; beyond that, duplicates are dropped after the lookup.
+         */
+        if (hwdb->properties_count < HWDB_PROPERTIES_SCAN_MAX) {
+                for (i = 0; i < hwdb->properties_count; i++)
+                        if (streq(hwdb->properties[i].name, key)) {
+                                hwdb->properties[i].value = value;
+                                return 0;
+                        }
+        } else
+                hwdb->properties_dups = true;
 
-        if (udev_list_entry_add(&hwdb->properties_list, key+1, value) == NULL)
+        if (!GREEDY_REALLOC(hwdb->properties, hwdb->properties_allocated, hwdb->properties_count + 1))
                 return -ENOMEM;
+        hwdb->properties[hwdb->properties_count].name = key;
+        hwdb->properties[hwdb->properties_count].value = value;
+        hwdb->properties[hwdb->properties_count].order = hwdb->properties_count;
+        hwdb->properties_count++;
         return 0;
 }
 
-static int trie_fnmatch_f(struct udev_hwdb *hwdb, const struct trie_node_f *node, size_t p,
+static int hwdb_property_cmp(const void *a, const void *b) {
+        const struct hwdb_property *pa = a, *pb = b;
+        int r;
+
+        r = strcmp(pa->name, pb->name);
+        if (r != 0)
+                return r;
+        return pa->order < pb->order ? -1 : pa->order > pb->order;
+}
+
+/* sort the properties by name, and keep only the last value of every name */
+static void hwdb_properties_dedup(struct udev_hwdb *hwdb) {
+        size_t i, n = 0;
+
+        qsort(hwdb->properties, hwdb->properties_count, sizeof(struct hwdb_property), hwdb_property_cmp);
+        for (i = 0; i < hwdb->properties_count; i++) {
+                if (i + 1 < hwdb->properties_count && streq(hwdb->properties[i].name, hwdb->properties[i + 1].name))
+                        continue;
+                hwdb->properties[n++] = hwdb->properties[i];
+        }
+        hwdb->properties_count = n;
+}
+
+static int trie_fnmatch_f(struct udev_hwdb *hwdb, const void *node, size_t p,
                           struct linebuf *buf, const char *search) {
         size_t len;
         size_t i;
         const char *prefix;
         int err;
 
-        prefix = trie_string(hwdb, node->prefix_off);
+        hwdb->nodes_visited++;
+        prefix = trie_node_prefix(hwdb, node);
         len = strlen(prefix + p);
         linebuf_add(buf, prefix + p, len);
 
-        for (i = 0; i < node->children_count; i++) {
-                const struct trie_child_entry_f *child = &trie_node_children(hwdb, node)[i];
+        for (i = 0; i < trie_node_child_slots(hwdb, node); i++) {
+                const void *child;
+                uint8_t c;
+
+                child = trie_node_child(hwdb, node, i, &c);
+                if (!child)
+                        continue;
 
-                linebuf_add_char(buf, child->c);
-                err = trie_fnmatch_f(hwdb, trie_node_from_off(hwdb, child->child_off), 0, buf, search);
+                linebuf_add_char(buf, c);
+                err = trie_fnmatch_f(hwdb, child, 0, buf, search);
                 if (err < 0)
                         return err;
                 linebuf_rem_char(buf);
         }
 
-        if (le64toh(node->values_count) && fnmatch(linebuf_get(buf), search, 0) == 0)
-                for (i = 0; i < le64toh(node->values_count); i++) {
-                        err = hwdb_add_property(hwdb, trie_string(hwdb, trie_node_values(hwdb, node)[i].key_off),
-                                                trie_string(hwdb, trie_node_values(hwdb, node)[i].value_off));
+        if (trie_node_values_count(hwdb, node) && fnmatch(linebuf_get(buf), search, 0) == 0)
+                for (i = 0; i < trie_node_values_count(hwdb, node); i++) {
+                        const char *key, *value;
+
+                        trie_node_value(hwdb, node, i, &key, &value);
+                        err = hwdb_add_property(hwdb, key, value);
                         if (err < 0)
                                 return err;
                 }
@@ -185,64 +377,152 @@ static int trie_fnmatch_f(struct udev_hwdb *hwdb, const struct trie_node_f *node
         return 0;
 }
 
+/* match a pattern whose only wildcard is '*', like fnmatch() does */
+static bool glob_match_star(const char *pattern, const char *s) {
+        const char *star = NULL;
+        const char *retry = NULL;
+
+        while (*s) {
+                if (*pattern == '*') {
+                        star = ++pattern;
+                        retry = s;
+                } else if (*pattern == *s) {
+                        pattern++;
+                        s++;
+                } else if (star) {
+                        pattern = star;
+                        s = ++retry;
+                } else
+                        return false;
+        }
+
+        while (*pattern == '*')
+                pattern++;
+        return *pattern == '\0';
+}
+
+static int trie_glob_groups_cmp_f2(const void *key, const void *v) {
+        uint32_t node_off = *(const uint32_t *)key;
+        uint32_t off = read_le32(v);
+
+        return node_off < off ? -1 : node_off > off;
+}
+
+/* the group of matches in the glob index, which have their first wildcard at the node */
+static const struct trie_glob_group_f2 *trie_glob_group_f2(struct udev_hwdb *hwdb, const void *node) {
+        uint32_t node_off = (const char *)node - hwdb->map;
+
+        if (hwdb->globs_count == 0)
+                return NULL;
+        return bsearch(&node_off, hwdb->map + hwdb->globs_off, hwdb->globs_count,
+                       hwdb->glob_group_size, trie_glob_groups_cmp_f2);
+}
+
+static int trie_search_globs_f2(struct udev_hwdb *hwdb, const struct trie_glob_group_f2 *group,
+                                const char *search) {
+        const char *entries;
+        uint32_t i;
+        int err;
+
+        entries = hwdb->map + le32toh(group->entries_off);
+        for (i = 0; i < le32toh(group->entries_count); i++) {
+                const struct trie_glob_entry_f2 *e = (const void *)(entries + i * hwdb->glob_entry_size);
+                const char *pattern = trie_string(hwdb, le32toh(e->pattern_off));
+                const void *values;
+                size_t n;
+
+                if (e->flags & TRIE_GLOB_F2_STAR) {
+                        if (!glob_match_star(pattern, search))
+                                continue;
+                } else if (fnmatch(pattern, search, 0) != 0)
+                        continue;
+
+                values = trie_node_from_off(hwdb, le32toh(e->node_off));
+                hwdb->nodes_visited++;
+                for (n = 0; n < trie_node_values_count(hwdb, values); n++) {
+                        const char *key, *value;
+
+                        trie_node_value(hwdb, values, n, &key, &value);
+                        err = hwdb_add_property(hwdb, key, value);
+                        if (err < 0)
+                                return err;
+                }
+        }
+        return 0;
+}
+
 static int trie_search_f(struct udev_hwdb *hwdb, const char *search) {
+        const struct trie_glob_group_f2 *group;
         struct linebuf buf;
-        const struct trie_node_f *node;
+        const void *node;
         size_t i = 0;
         int err;
 
         linebuf_init(&buf);
 
-        node = trie_node_from_off(hwdb, hwdb->head->nodes_root_off);
+        node = trie_node_from_off(hwdb, hwdb->nodes_root_off);
         while (node) {
-                const struct trie_node_f *child;
+                const void *child;
+                const char *prefix;
                 size_t p = 0;
-
-                if (node->prefix_off) {
-                        uint8_t c;
-
-                        for (; (c = trie_string(hwdb, node->prefix_off)[p]); p++) {
-                                if (c == '*' || c == '?' || c == '[')
-                                        return trie_fnmatch_f(hwdb, node, p, &buf, search + i + p);
-                                if (c != search[i + p])
-                                        return 0;
+                uint8_t c;
+
+                hwdb->nodes_visited++;
+                prefix = trie_node_prefix(hwdb, node);
+                for (; (c = prefix[p]); p++) {
+                        if (c == '*' || c == '?' || c == '[') {
+                                group = trie_glob_group_f2(hwdb, node);
+                                if (group)
+                                        return trie_search_globs_f2(hwdb, group, search + i + p);
+                                return trie_fnmatch_f(hwdb, node, p, &buf, search + i + p);
                         }
-                        i += p;
+                        if (c != search[i + p])
+                                return 0;
                 }
+                i += p;
 
-                child = node_lookup_f(hwdb, node, '*');
-                if (child) {
-                        linebuf_add_char(&buf, '*');
-                        err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
+                group = trie_glob_group_f2(hwdb, node);
+                if (group) {
+                        err = trie_search_globs_f2(hwdb, group, search + i);
                         if (err < 0)
                                 return err;
-                        linebuf_rem_char(&buf);
-                }
+                } else {
+                        child = node_lookup_f(hwdb, node, '*');
+                        if (child) {
+                                linebuf_add_char(&buf, '*');
+                                err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
+                                if (err < 0)
+                                        return err;
+                                linebuf_rem_char(&buf);
+                        }
 
-                child = node_lookup_f(hwdb, node, '?');
-                if (child) {
-                        linebuf_add_char(&buf, '?');
-                        err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
-                        if (err < 0)
-                                return err;
-                        linebuf_rem_char(&buf);
-                }
+                        child = node_lookup_f(hwdb, node, '?');
+                        if (child) {
+                                linebuf_add_char(&buf, '?');
+                                err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
+                                if (err < 0)
+                                        return err;
+                                linebuf_rem_char(&buf);
+                        }
 
-                child = node_lookup_f(hwdb, node, '[');
-                if (child) {
-                        linebuf_add_char(&buf, '[');
-                        err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
-                        if (err < 0)
-                                return err;
-                        linebuf_rem_char(&buf);
+                        child = node_lookup_f(hwdb, node, '[');
+                        if (child) {
+                                linebuf_add_char(&buf, '[');
+                                err = trie_fnmatch_f(hwdb, child, 0, &buf, search + i);
+                                if (err < 0)
+                                        return err;
+                                linebuf_rem_char(&buf);
+                        }
                 }
 
                 if (search[i] == '\0') {
                         size_t n;
 
-                        for (n = 0; n < le64toh(node->values_count); n++) {
-                                err = hwdb_add_property(hwdb, trie_string(hwdb, trie_node_values(hwdb, node)[n].key_off),
-                                                        trie_string(hwdb, trie_node_values(hwdb, node)[n].value_off));
+                        for (n = 0; n < trie_node_values_count(hwdb, node); n++) {
+                                const char *key, *value;
+
+                                trie_node_value(hwdb, node, n, &key, &value);
+                                err = hwdb_add_property(hwdb, key, value);
                                 if (err < 0)
                                         return err;
                         }
@@ -256,6 +536,33 @@ static int trie_search_f(struct udev_hwdb *hwdb, const char *search) {
         return 0;
 }
 
+static int hwdb_search(struct udev_hwdb *hwdb, const char *modalias) {
+        int err;
+
+        hwdb->properties_count = 0;
+        hwdb->properties_dups = false;
+        hwdb->nodes_visited = 0;
+        err = trie_search_f(hwdb, modalias);
+        if (err < 0)
+                return err;
+        if (hwdb->properties_dups)
+                hwdb_properties_dedup(hwdb);
+        return 0;
+}
+
+/* copy the properties of the last lookup to the list, which is sorted by name */
+static struct udev_list_entry *hwdb_properties_list(struct udev_hwdb *hwdb) {
+        size_t i;
+
+        udev_list_cleanup(&hwdb->properties_list);
+        for (i = 0; i < hwdb->properties_count; i++)
+                if (!udev_list_entry_add(&hwdb->properties_list, hwdb->properties[i].name, hwdb->properties[i].value)) {
+                        errno = ENOMEM;
+                        return NULL;
+                }
+        return udev_list_get_entry(&hwdb->properties_list);
+}
+
 /**
  * udev_hwdb_new:
  * @udev: udev library context
@@ -265,8 +572,14 @@ static int trie_search_f(struct udev_hwdb *hwdb, const char *search) {
  * Returns: a hwdb context.
  **/
 _public_ struct udev_hwdb *udev_hwdb_new(struct udev *udev) {
+        return udev_hwdb_new_from_path(udev, UDEV_HWDB_BIN);
+}
+
+/* open a database at a different location, used by the tests */
+struct udev_hwdb *udev_hwdb_new_from_path(struct udev *udev, const char *path) {
         struct udev_hwdb *hwdb;
         const char sig[] = HWDB_SIG;
+        const char sig_v2[] = HWDB_SIG_V2;
 
         hwdb = new0(struct udev_hwdb, 1);
         if (!hwdb)
@@ -275,40 +588,75 @@ _public_ struct udev_hwdb *udev_hwdb_new(struct udev *udev) {
         hwdb->refcount = 1;
         udev_list_init(udev, &hwdb->properties_list, true);
 
-        hwdb->f = fopen(UDEV_HWDB_BIN, "re");
+        hwdb->f = fopen(path, "re");
         if (!hwdb->f) {
-                log_debug(UDEV_HWDB_BIN " does not exist, please run udevadm hwdb --update");
+                log_debug("%s does not exist, please run udevadm hwdb --update", path);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
         if (fstat(fileno(hwdb->f), &hwdb->st) < 0 ||
             (size_t)hwdb->st.st_size < offsetof(struct trie_header_f, strings_len) + 8) {
-                log_debug_errno(errno, "error reading " UDEV_HWDB_BIN ": %m");
+                log_debug_errno(errno, "error reading %s: %m", path);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
         hwdb->map = mmap(0, hwdb->st.st_size, PROT_READ, MAP_SHARED, fileno(hwdb->f), 0);
         if (hwdb->map == MAP_FAILED) {
-                log_debug_errno(errno, "error mapping " UDEV_HWDB_BIN ": %m");
+                log_debug_errno(errno, "error mapping %s: %m", path);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
-        if (memcmp(hwdb->map, sig, sizeof(hwdb->head->signature)) != 0 ||
-            (size_t)hwdb->st.st_size != le64toh(hwdb->head->file_size)) {
-                log_debug("error recognizing the format of " UDEV_HWDB_BIN);
+        if (memcmp(hwdb->map, sig, sizeof(hwdb->head->signature)) == 0 &&
+            (size_t)hwdb->st.st_size == le64toh(hwdb->head->file_size)) {
+                hwdb->version = 1;
+                hwdb->nodes_root_off = le64toh(hwdb->head->nodes_root_off);
+                hwdb->node_size = le64toh(hwdb->head->node_size);
+                hwdb->child_entry_size = le64toh(hwdb->head->child_entry_size);
+                hwdb->value_entry_size = le64toh(hwdb->head->value_entry_size);
+        } else if (memcmp(hwdb->map, sig_v2, sizeof(hwdb->head2->signature)) == 0 &&
+                   (size_t)hwdb->st.st_size >= offsetof(struct trie_header_f2, strings_len) + sizeof(le32_t) &&
+                   (size_t)hwdb->st.st_size == le64toh(hwdb->head2->file_size) &&
+                   le32toh(hwdb->head2->node_size) >= sizeof(struct trie_node_f2) &&
+                   le32toh(hwdb->head2->value_entry_size) >= sizeof(struct trie_value_entry_f2)) {
+                hwdb->version = 2;
+                hwdb->nodes_root_off = le32toh(hwdb->head2->nodes_root_off);
+                hwdb->node_size = le32toh(hwdb->head2->node_size);
+                hwdb->value_entry_size = le32toh(hwdb->head2->value_entry_size);
+
+                /* without glob index, the search walks the trie below wildcards */
+                if (le32toh(hwdb->head2->header_size) >= offsetof(struct trie_header_f2, globs_count) + sizeof(le32_t) &&
+                    le32toh(hwdb->head2->glob_group_size) >= sizeof(struct trie_glob_group_f2) &&
+                    le32toh(hwdb->head2->glob_entry_size) >= sizeof(struct trie_glob_entry_f2)) {
+                        hwdb->globs_off = le32toh(hwdb->head2->globs_off);
+                        hwdb->globs_count = le32toh(hwdb->head2->globs_count);
+                        hwdb->glob_group_size = le32toh(hwdb->head2->glob_group_size);
+                        hwdb->glob_entry_size = le32toh(hwdb->head2->glob_entry_size);
+                        if (hwdb->globs_off + (uint64_t)hwdb->globs_count * hwdb->glob_group_size > (uint64_t)hwdb->st.st_size)
+                                hwdb->globs_count = 0;
+                }
+        } else {
+                log_debug("error recognizing the format of %s", path);
                 udev_hwdb_unref(hwdb);
                 return NULL;
         }
 
         log_debug("=== trie on-disk ===");
+        log_debug("format version:        %u", hwdb->version);
         log_debug("tool version:          %"PRIu64, le64toh(hwdb->head->tool_version));
         log_debug("file size:        %8"PRIu64" bytes", hwdb->st.st_size);
-        log_debug("header size       %8"PRIu64" bytes", le64toh(hwdb->head->header_size));
-        log_debug("strings           %8"PRIu64" bytes", le64toh(hwdb->head->strings_len));
-        log_debug("nodes             %8"PRIu64" bytes", le64toh(hwdb->head->nodes_len));
+        if (hwdb->version >= 2) {
+                log_debug("header size       %8"PRIu32" bytes", le32toh(hwdb->head2->header_size));
+                log_debug("strings           %8"PRIu32" bytes", le32toh(hwdb->head2->strings_len));
+                log_debug("nodes             %8"PRIu32" bytes", le32toh(hwdb->head2->nodes_len));
+                log_debug("glob index        %8zu groups", hwdb->globs_count);
+        } else {
+                log_debug("header size       %8"PRIu64" bytes", le64toh(hwdb->head->header_size));
+                log_debug("strings           %8"PRIu64" bytes", le64toh(hwdb->head->strings_len));
+                log_debug("nodes             %8"PRIu64" bytes", le64toh(hwdb->head->nodes_len));
+        }
         return hwdb;
 }
 
@@ -347,6 +695,7 @@ _public_ struct udev_hwdb *udev_hwdb_unref(struct udev_hwdb *hwdb) {
         if (hwdb->f)
                 fclose(hwdb->f);
         udev_list_cleanup(&hwdb->properties_list);
+        free(hwdb->properties);
         free(hwdb);
         return NULL;
 }
@@ -358,7 +707,7 @@ bool udev_hwdb_validate(struct udev_hwdb *hwdb) {
                 return false;
         if (!hwdb->f)
                 return false;
-        if (stat("/etc/udev/hwdb.bin", &st) < 0)
+        if (stat(UDEV_HWDB_BIN, &st) < 0)
                 return true;
 
         if (timespec_load(&hwdb->st.st_mtim) != timespec_load(&st.st_mtim))
@@ -387,11 +736,200 @@ _public_ struct udev_list_entry *udev_hwdb_get_properties_list_entry(struct udev
                 return NULL;
         }
 
-        udev_list_cleanup(&hwdb->properties_list);
-        err = trie_search_f(hwdb, modalias);
+        err = hwdb_search(hwdb, modalias);
         if (err < 0) {
                 errno = -err;
                 return NULL;
         }
-        return udev_list_get_entry(&hwdb->properties_list);
+        return hwdb_properties_list(hwdb);
+}
+
+/**
+ * udev_hwdb_lookup:
+ * @hwdb: context
+ * @modalias: modalias string
+ *
+ * Lookup a matching device in the hardware database, like
+ * udev_hwdb_get_properties_list_entry(), but without copying the
+ * retrieved properties. Their names and values are read with
+ * udev_hwdb_get_property_name() and udev_hwdb_get_property_value().
+ * They point into the mapped database, and are valid until the next
+ * lookup. Their order is unspecified.
+ *
+ * Returns: the number of retrieved properties, or a negative errno value.
+ */
+_public_ int udev_hwdb_lookup(struct udev_hwdb *hwdb, const char *modalias) {
+        int err;
+
+        if (!hwdb || !hwdb->f || !modalias)
+                return -EINVAL;
+
+        err = hwdb_search(hwdb, modalias);
+        if (err < 0)
+                return err;
+        return hwdb->properties_count;
+}
+
+/**
+ * udev_hwdb_get_property_name:
+ * @hwdb: context
+ * @index: index of a property retrieved by the last udev_hwdb_lookup()
+ *
+ * Returns: the name of the property, or #NULL if @index is out of range.
+ */
+_public_ const char *udev_hwdb_get_property_name(struct udev_hwdb *hwdb, unsigned int index) {
+        if (!hwdb || index >= hwdb->properties_count)
+                return NULL;
+        return hwdb->properties[index].name;
+}
+
+/**
+ * udev_hwdb_get_property_value:
+ * @hwdb: context
+ * @index: index of a property retrieved by the last udev_hwdb_lookup()
+ *
+ * Returns: the value of the property, or #NULL if @index is out of range.
+ */
+_public_ const char *udev_hwdb_get_property_value(struct udev_hwdb *hwdb, unsigned int index) {
+        if (!hwdb || index >= hwdb->properties_count)
+                return NULL;
+        return hwdb->properties[index].value;
+}
+
+uint64_t udev_hwdb_get_nodes_visited(struct udev_hwdb *hwdb) {
+        return hwdb->nodes_visited;
+}
+
+static void trie_stats_f(struct udev_hwdb *hwdb, const void *node, unsigned int depth,
+                         struct udev_hwdb_stats *stats) {
+        unsigned int children = 0, bucket = 0;
+        bool glob;
+        size_t i;
+
+        glob = strpbrk(trie_node_prefix(hwdb, node), "*?[") != NULL;
+        for (i = 0; i < trie_node_child_slots(hwdb, node); i++) {
+                const void *child;
+                uint8_t c;
+
+                child = trie_node_child(hwdb, node, i, &c);
+                if (!child)
+                        continue;
+                children++;
+                if (c == '*' || c == '?' || c == '[')
+                        glob = true;
+                trie_stats_f(hwdb, child, depth + 1, stats);
+        }
+
+        stats->nodes++;
+        if (glob)
+                stats->glob_nodes++;
+        if (trie_node_values_count(hwdb, node) > 0) {
+                stats->values += trie_node_values_count(hwdb, node);
+                stats->value_nodes++;
+                stats->depth_sum += depth;
+                stats->depth_max = MAX(stats->depth_max, depth);
+        }
+
+        while (children >> bucket && bucket < UDEV_HWDB_FANOUT_BUCKETS - 1)
+                bucket++;
+        stats->fanout[bucket]++;
+}
+
+/* walk the whole trie, to describe its shape */
+int udev_hwdb_get_stats(struct udev_hwdb *hwdb, struct udev_hwdb_stats *stats) {
+        const struct trie_glob_group_f2 *group;
+        size_t i;
+
+        if (!hwdb || !hwdb->f)
+                return -EINVAL;
+
+        memset(stats, 0, sizeof(struct udev_hwdb_stats));
+        stats->version = hwdb->version;
+        stats->file_size = hwdb->st.st_size;
+        if (hwdb->version >= 2) {
+                stats->nodes_len = le32toh(hwdb->head2->nodes_len);
+                stats->strings_len = le32toh(hwdb->head2->strings_len);
+        } else {
+                stats->nodes_len = le64toh(hwdb->head->nodes_len);
+                stats->strings_len = le64toh(hwdb->head->strings_len);
+        }
+
+        for (i = 0; i < hwdb->globs_count; i++) {
+                group = (const void *)(hwdb->map + hwdb->globs_off + i * hwdb->glob_group_size);
+                stats->glob_groups++;
+                stats->glob_entries += le32toh(group->entries_count);
+        }
+
+        trie_stats_f(hwdb, trie_node_from_off(hwdb, hwdb->nodes_root_off), 0, stats);
+        return 0;
+}
+
+struct batch_key {
+        const char *modalias;
+        size_t index;
+};
+
+static int batch_key_cmp(const void *v1, const void *v2) {
+        const struct batch_key *k1 = v1;
+        const struct batch_key *k2 = v2;
+
+        return strcmp(k1->modalias, k2->modalias);
+}
+
+/**
+ * udev_hwdb_lookup_batch:
+ * @hwdb: context
+ * @modaliases: array of lookup keys
+ * @n: number of keys
+ * @cb: function called with the properties of every key
+ * @userdata: data pointer passed to @cb
+ *
+ * Lookup many keys at once. The keys are searched in sorted order, so
+ * that neighbouring keys touch the same parts of the database, and the
+ * result of a repeated key is reused. @cb is called once for every key,
+ * in no particular order, with the index of the key in @modaliases and
+ * the first entry of its list of properties. The list is only valid
+ * during the call. If @cb returns a negative value, the lookup stops.
+ *
+ * Returns: 0, the negative value returned by @cb, or a negative errno value.
+ */
+_public_ int udev_hwdb_lookup_batch(struct udev_hwdb *hwdb, const char * const *modaliases, size_t n,
+                                    int (*cb)(struct udev_hwdb *hwdb, size_t index,
+                                              struct udev_list_entry *list, void *userdata),
+                                    void *userdata) {
+        _cleanup_free_ struct batch_key *keys = NULL;
+        struct udev_list_entry *list = NULL;
+        size_t i;
+        int err;
+
+        if (!hwdb || !hwdb->f || !cb)
+                return -EINVAL;
+        if (n == 0)
+                return 0;
+
+        keys = new(struct batch_key, n);
+        if (!keys)
+                return -ENOMEM;
+        for (i = 0; i < n; i++) {
+                keys[i].modalias = modaliases[i];
+                keys[i].index = i;
+        }
+        qsort(keys, n, sizeof(struct batch_key), batch_key_cmp);
+
+        for (i = 0; i < n; i++) {
+                if (i == 0 || !streq(keys[i].modalias, keys[i-1].modalias)) {
+                        err = hwdb_search(hwdb, keys[i].modalias);
+                        if (err < 0)
+                                return err;
+                        list = hwdb_properties_list(hwdb);
+                        if (!list && hwdb->properties_count > 0)
+                                return -ENOMEM;
+                }
+
+                err = cb(hwdb, keys[i].index, list, userdata);
+                if (err < 0)
+                        return err;
+        }
+
+        return 0;
 }
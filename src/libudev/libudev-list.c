@@ -46,6 +46,10 @@ struct udev_list_entry {
         char *name;
         char *value;
         int num;
+        /* the initial value, and the name if not interned, are stored in the entry itself */
+        char *value_buf;
+        size_t value_size;
+        char buf[];
 };
 
 /* the list's head points to itself if empty */
@@ -109,139 +113,120 @@ static void udev_list_entry_append(struct udev_list_entry *new, struct udev_list
         new->list = list;
 }
 
-/* insert entry into a list, before a given existing entry */
-static void udev_list_entry_insert_before(struct udev_list_entry *new, struct udev_list_entry *entry)
+static bool udev_list_entry_value_is_inline(struct udev_list_entry *entry)
 {
-        udev_list_node_insert_between(&new->node, entry->node.prev, &entry->node);
-        new->list = entry->list;
+        return entry->value != NULL && entry->value == entry->value_buf;
 }
 
-/* binary search in sorted array */
-static int list_search(struct udev_list *list, const char *name)
+static int udev_list_entry_set_value(struct udev_list_entry *entry, const char *value)
 {
-        unsigned int first, last;
-
-        first = 0;
-        last = list->entries_cur;
-        while (first < last) {
-                unsigned int i;
-                int cmp;
-
-                i = (first + last)/2;
-                cmp = strcmp(name, list->entries[i]->name);
-                if (cmp < 0)
-                        last = i;
-                else if (cmp > 0)
-                        first = i+1;
-                else
-                        return i;
+        size_t len;
+
+        if (value == NULL) {
+                if (!udev_list_entry_value_is_inline(entry))
+                        free(entry->value);
+                entry->value = NULL;
+                return 0;
+        }
+
+        len = strlen(value) + 1;
+
+        /* reuse the inline storage if the new value fits */
+        if (len <= entry->value_size) {
+                if (!udev_list_entry_value_is_inline(entry))
+                        free(entry->value);
+                entry->value = memcpy(entry->value_buf, value, len);
+                return 0;
         }
 
-        /* not found, return negative insertion-index+1 */
-        return -(first+1);
+        if (!udev_list_entry_value_is_inline(entry))
+                free(entry->value);
+        entry->value = strdup(value);
+        if (entry->value == NULL)
+                return -ENOMEM;
+        return 0;
+}
+
+static void udev_list_entry_free(struct udev_list_entry *entry, struct udev_list *list)
+{
+        if (!udev_list_entry_value_is_inline(entry))
+                free(entry->value);
+        if (list->interned)
+                udev_free(list->udev, entry, offsetof(struct udev_list_entry, buf) + entry->value_size);
+        else
+                free(entry);
 }
 
 struct udev_list_entry *udev_list_entry_add(struct udev_list *list, const char *name, const char *value)
 {
         struct udev_list_entry *entry;
-        int i = 0;
+        const char *interned_name = NULL;
+        size_t name_len, value_len;
 
         if (list->unique) {
-                /* lookup existing name or insertion-index */
-                i = list_search(list, name);
-                if (i >= 0) {
-                        entry = list->entries[i];
-
-                        free(entry->value);
-                        if (value == NULL) {
-                                entry->value = NULL;
-                                return entry;
-                        }
-                        entry->value = strdup(value);
-                        if (entry->value == NULL)
+                entry = hashmap_get(list->entries, name);
+                if (entry != NULL) {
+                        if (udev_list_entry_set_value(entry, value) < 0)
                                 return NULL;
                         return entry;
                 }
+
+                if (hashmap_ensure_allocated(&list->entries, &string_hash_ops) < 0)
+                        return NULL;
         }
 
-        /* add new name */
-        entry = new0(struct udev_list_entry, 1);
+        /* add new name, allocated in one chunk with the name and the value */
+        if (list->interned) {
+                interned_name = udev_intern_name(list->udev, name);
+                if (interned_name == NULL)
+                        return NULL;
+                name_len = 0;
+        } else
+                name_len = strlen(name) + 1;
+        value_len = value != NULL ? strlen(value) + 1 : 0;
+        if (list->interned)
+                entry = udev_alloc0(list->udev, offsetof(struct udev_list_entry, buf) + value_len);
+        else
+                entry = malloc0(offsetof(struct udev_list_entry, buf) + name_len + value_len);
         if (entry == NULL)
                 return NULL;
-        entry->name = strdup(name);
-        if (entry->name == NULL) {
-                free(entry);
-                return NULL;
-        }
-        if (value != NULL) {
-                entry->value = strdup(value);
-                if (entry->value == NULL) {
-                        free(entry->name);
-                        free(entry);
-                        return NULL;
-                }
-        }
+        if (interned_name != NULL)
+                entry->name = (char *) interned_name;
+        else
+                entry->name = memcpy(entry->buf, name, name_len);
+        entry->value_buf = entry->buf + name_len;
+        entry->value_size = value_len;
+        if (value != NULL)
+                entry->value = memcpy(entry->value_buf, value, value_len);
 
         if (list->unique) {
-                /* allocate or enlarge sorted array if needed */
-                if (list->entries_cur >= list->entries_max) {
-                        struct udev_list_entry **entries;
-                        unsigned int add;
-
-                        add = list->entries_max;
-                        if (add < 1)
-                                add = 64;
-                        entries = realloc(list->entries, (list->entries_max + add) * sizeof(struct udev_list_entry *));
-                        if (entries == NULL) {
-                                free(entry->name);
-                                free(entry->value);
-                                free(entry);
-                                return NULL;
-                        }
-                        list->entries = entries;
-                        list->entries_max += add;
+                struct udev_list_entry *last;
+
+                if (hashmap_put(list->entries, entry->name, entry) < 0) {
+                        udev_list_entry_free(entry, list);
+                        return NULL;
                 }
 
-                /* the negative i returned the insertion index */
-                i = (-i)-1;
-
-                /* insert into sorted list */
-                if ((unsigned int)i < list->entries_cur)
-                        udev_list_entry_insert_before(entry, list->entries[i]);
-                else
-                        udev_list_entry_append(entry, list);
-
-                /* insert into sorted array */
-                memmove(&list->entries[i+1], &list->entries[i],
-                        (list->entries_cur - i) * sizeof(struct udev_list_entry *));
-                list->entries[i] = entry;
-                list->entries_cur++;
-        } else {
-                udev_list_entry_append(entry, list);
+                /* unique lists are iterated in sorted order, sort lazily if needed */
+                if (!udev_list_node_is_empty(&list->node)) {
+                        last = list_node_to_entry(list->node.prev);
+                        if (strcmp(last->name, entry->name) > 0)
+                                list->unsorted = true;
+                }
         }
 
+        udev_list_entry_append(entry, list);
+
         return entry;
 }
 
 void udev_list_entry_delete(struct udev_list_entry *entry)
 {
-        if (entry->list->entries != NULL) {
-                int i;
-                struct udev_list *list = entry->list;
-
-                /* remove entry from sorted array */
-                i = list_search(list, entry->name);
-                if (i >= 0) {
-                        memmove(&list->entries[i], &list->entries[i+1],
-                                ((list->entries_cur-1) - i) * sizeof(struct udev_list_entry *));
-                        list->entries_cur--;
-                }
-        }
+        if (entry->list->entries != NULL)
+                hashmap_remove(entry->list->entries, entry->name);
 
         udev_list_node_remove(&entry->node);
-        free(entry->name);
-        free(entry->value);
-        free(entry);
+        udev_list_entry_free(entry, entry->list);
 }
 
 void udev_list_cleanup(struct udev_list *list)
@@ -249,21 +234,60 @@ void udev_list_cleanup(struct udev_list *list)
         struct udev_list_entry *entry_loop;
         struct udev_list_entry *entry_tmp;
 
-        free(list->entries);
+        hashmap_free(list->entries);
         list->entries = NULL;
-        list->entries_cur = 0;
-        list->entries_max = 0;
+        list->unsorted = false;
         udev_list_entry_foreach_safe(entry_loop, entry_tmp, udev_list_get_entry(list))
                 udev_list_entry_delete(entry_loop);
 }
 
+static int list_entry_compare(const void *a, const void *b)
+{
+        const struct udev_list_entry * const *e1 = a, * const *e2 = b;
+
+        return strcmp((*e1)->name, (*e2)->name);
+}
+
+/* entries are appended in insertion order, bring them into name order */
+static void udev_list_sort(struct udev_list *list)
+{
+        _cleanup_free_ struct udev_list_entry **entries = NULL;
+        struct udev_list_node *node;
+        unsigned int n, i;
+
+        n = hashmap_size(list->entries);
+        entries = new(struct udev_list_entry *, n);
+        if (entries == NULL)
+                return;
+
+        i = 0;
+        udev_list_node_foreach(node, &list->node)
+                entries[i++] = list_node_to_entry(node);
+        qsort(entries, n, sizeof(struct udev_list_entry *), list_entry_compare);
+
+        udev_list_node_init(&list->node);
+        for (i = 0; i < n; i++)
+                udev_list_node_append(&entries[i]->node, &list->node);
+        list->unsorted = false;
+}
+
 struct udev_list_entry *udev_list_get_entry(struct udev_list *list)
 {
         if (udev_list_node_is_empty(&list->node))
                 return NULL;
+        if (list->unsorted)
+                udev_list_sort(list);
         return list_node_to_entry(list->node.next);
 }
 
+/* lookup in a unique list, without the need to sort it for iteration */
+struct udev_list_entry *udev_list_get_entry_by_name(struct udev_list *list, const char *name)
+{
+        if (!list->unique)
+                return NULL;
+        return hashmap_get(list->entries, name);
+}
+
 /**
  * udev_list_entry_get_next:
  * @list_entry: current entry
@@ -296,18 +320,10 @@ _public_ struct udev_list_entry *udev_list_entry_get_next(struct udev_list_entry
  */
 _public_ struct udev_list_entry *udev_list_entry_get_by_name(struct udev_list_entry *list_entry, const char *name)
 {
-        int i;
-
         if (list_entry == NULL)
                 return NULL;
 
-        if (!list_entry->list->unique)
-                return NULL;
-
-        i = list_search(list_entry->list, name);
-        if (i < 0)
-                return NULL;
-        return list_entry->list->entries[i];
+        return udev_list_get_entry_by_name(list_entry->list, name);
 }
 
 /**
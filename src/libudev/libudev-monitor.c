@@ -25,6 +25,7 @@
 #include <string.h>
 #include <dirent.h>
 #include <poll.h>
+#include <fnmatch.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -59,6 +60,10 @@ struct udev_monitor {
         socklen_t addrlen;
         struct udev_list filter_subsystem_list;
         struct udev_list filter_tag_list;
+        struct udev_list filter_sysname_list;
+        struct udev_list filter_property_list;
+        struct udev_monitor_rx *rx;
+        int rx_error;
         bool bound;
 };
 
@@ -90,6 +95,24 @@ struct udev_monitor_netlink_header {
         unsigned int filter_devtype_hash;
         unsigned int filter_tag_bloom_hi;
         unsigned int filter_tag_bloom_lo;
+        /*
+         * appended fields, only valid if header_size includes them; the bloom
+         * filter carries the KEY=value strings of the filter_property_keys
+         */
+        unsigned int filter_sysname_hash;
+        unsigned int filter_property_bloom_hi;
+        unsigned int filter_property_bloom_lo;
+};
+
+/* properties which can be matched by the in-kernel socket filter */
+static const char * const filter_property_keys[] = {
+        "ID_SERIAL",
+        "ID_SERIAL_SHORT",
+        "ID_PATH",
+        "ID_FS_UUID",
+        "ID_FS_LABEL",
+        "DM_NAME",
+        "DM_UUID",
 };
 
 static struct udev_monitor *udev_monitor_new(struct udev *udev)
@@ -103,6 +126,8 @@ static struct udev_monitor *udev_monitor_new(struct udev *udev)
         udev_monitor->udev = udev;
         udev_list_init(udev, &udev_monitor->filter_subsystem_list, false);
         udev_list_init(udev, &udev_monitor->filter_tag_list, true);
+        udev_list_init(udev, &udev_monitor->filter_sysname_list, true);
+        udev_list_init(udev, &udev_monitor->filter_property_list, false);
         return udev_monitor;
 }
 
@@ -273,6 +298,54 @@ static inline void bpf_jmp(struct sock_filter *inss, unsigned int *i,
         (*i)++;
 }
 
+static uint64_t property_bloom64(const char *key, const char *value)
+{
+        char str[UTIL_LINE_SIZE];
+
+        strscpyl(str, sizeof(str), key, "=", value, NULL);
+        return util_string_bloom64(str);
+}
+
+static bool filter_property_key(const char *key)
+{
+        unsigned int i;
+
+        for (i = 0; i < ELEMENTSOF(filter_property_keys); i++)
+                if (streq(filter_property_keys[i], key))
+                        return true;
+        return false;
+}
+
+/* all sysname matches are exact and can be checked in the kernel */
+static bool filter_sysname_in_kernel(struct udev_monitor *udev_monitor)
+{
+        struct udev_list_entry *list_entry;
+        unsigned int n = 0;
+
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list)) {
+                if (string_is_glob(udev_list_entry_get_name(list_entry)))
+                        return false;
+                n++;
+        }
+        /* jump offsets are limited to 8 bits */
+        return n > 0 && n < 250;
+}
+
+/* all property matches are exact and of properties carried in the bloom filter */
+static bool filter_property_in_kernel(struct udev_monitor *udev_monitor)
+{
+        struct udev_list_entry *list_entry;
+        unsigned int n = 0;
+
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list)) {
+                if (!filter_property_key(udev_list_entry_get_name(list_entry)) ||
+                    string_is_glob(udev_list_entry_get_value(list_entry)))
+                        return false;
+                n++;
+        }
+        return n > 0 && n < 40;
+}
+
 /**
  * udev_monitor_filter_update:
  * @udev_monitor: monitor
@@ -288,10 +361,47 @@ _public_ int udev_monitor_filter_update(struct udev_monitor *udev_monitor)
         struct sock_fprog filter;
         unsigned int i;
         struct udev_list_entry *list_entry;
+        unsigned int subsystem_size = 0;
+        unsigned int tag_matches = 0;
+        unsigned int sysname_matches = 0;
+        unsigned int property_matches = 0;
+        unsigned int budget;
         int err;
 
+        bool tag, sysname, property;
+
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_subsystem_list))
+                subsystem_size += udev_list_entry_get_value(list_entry) == NULL ? 3 : 5;
+        if (subsystem_size > 0)
+                subsystem_size++;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_tag_list))
+                tag_matches++;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list))
+                sysname_matches++;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list))
+                property_matches++;
+
+        /* the subsystem matches, the magic check and the final return must fit */
+        if (subsystem_size + 4 > ELEMENTSOF(ins))
+                return -E2BIG;
+        budget = ELEMENTSOF(ins) - subsystem_size - 4;
+
+        /*
+         * The other match blocks are installed only if they fit as a whole,
+         * and their jumps fit the 8 bit offsets; passes_filter() applies all
+         * matches again in userspace.
+         */
+        tag = tag_matches > 0 && 1 + (tag_matches - 1) * 6 <= 255 && tag_matches * 6 + 1 <= budget;
+        if (tag)
+                budget -= tag_matches * 6 + 1;
+        /* the sysname and property blocks share the header size check */
+        sysname = filter_sysname_in_kernel(udev_monitor) && sysname_matches + 2 + 3 <= budget;
+        if (sysname)
+                budget -= sysname_matches + 2 + 3;
+        property = filter_property_in_kernel(udev_monitor) && property_matches * 6 + 1 + (sysname ? 0 : 3) <= budget;
+
         if (udev_list_get_entry(&udev_monitor->filter_subsystem_list) == NULL &&
-            udev_list_get_entry(&udev_monitor->filter_tag_list) == NULL)
+            !tag && !sysname && !property)
                 return 0;
 
         memzero(ins, sizeof(ins));
@@ -304,14 +414,56 @@ _public_ int udev_monitor_filter_update(struct udev_monitor *udev_monitor)
         /* wrong magic, pass packet */
         bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
 
-        if (udev_list_get_entry(&udev_monitor->filter_tag_list) != NULL) {
-                int tag_matches;
+        if (sysname || property) {
+                /*
+                 * load header size in A; it is stored in host order, and loaded
+                 * byte-swapped on little-endian, which keeps the order of values
+                 * smaller than 256
+                 */
+                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(struct udev_monitor_netlink_header, header_size));
+                /* the sender does not provide the sysname and property fields, pass packet */
+                bpf_jmp(ins, &i, BPF_JMP|BPF_JGE|BPF_K, htonl(sizeof(struct udev_monitor_netlink_header)), 1, 0);
+                bpf_stmt(ins, &i, BPF_RET|BPF_K, 0xffffffff);
+        }
+
+        if (sysname) {
+                /* load device sysname hash in A */
+                bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(struct udev_monitor_netlink_header, filter_sysname_hash));
+                udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list)) {
+                        unsigned int hash = util_string_hash32(udev_list_entry_get_name(list_entry));
+
+                        /* jump behind end of sysname match block if sysname matches */
+                        sysname_matches--;
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, hash, 1 + sysname_matches, 0);
+                }
+
+                /* nothing matched, drop packet */
+                bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+        }
+
+        if (property) {
+                /* same as the tag match block */
+                udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list)) {
+                        uint64_t bloom_bits = property_bloom64(udev_list_entry_get_name(list_entry),
+                                                               udev_list_entry_get_value(list_entry));
+                        uint32_t bloom_hi = bloom_bits >> 32;
+                        uint32_t bloom_lo = bloom_bits & 0xffffffff;
+
+                        bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(struct udev_monitor_netlink_header, filter_property_bloom_hi));
+                        bpf_stmt(ins, &i, BPF_ALU|BPF_AND|BPF_K, bloom_hi);
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, bloom_hi, 0, 3);
+
+                        bpf_stmt(ins, &i, BPF_LD|BPF_W|BPF_ABS, offsetof(struct udev_monitor_netlink_header, filter_property_bloom_lo));
+                        bpf_stmt(ins, &i, BPF_ALU|BPF_AND|BPF_K, bloom_lo);
+                        property_matches--;
+                        bpf_jmp(ins, &i, BPF_JMP|BPF_JEQ|BPF_K, bloom_lo, 1 + (property_matches * 6), 0);
+                }
 
-                /* count tag matches, to calculate end of tag match block */
-                tag_matches = 0;
-                udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_tag_list))
-                        tag_matches++;
+                /* nothing matched, drop packet */
+                bpf_stmt(ins, &i, BPF_RET|BPF_K, 0);
+        }
 
+        if (tag) {
                 /* add all tags matches */
                 udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_tag_list)) {
                         uint64_t tag_bloom_bits = util_string_bloom64(udev_list_entry_get_name(list_entry));
@@ -487,6 +639,9 @@ _public_ struct udev_monitor *udev_monitor_unref(struct udev_monitor *udev_monit
                 close(udev_monitor->sock);
         udev_list_cleanup(&udev_monitor->filter_subsystem_list);
         udev_list_cleanup(&udev_monitor->filter_tag_list);
+        udev_list_cleanup(&udev_monitor->filter_sysname_list);
+        udev_list_cleanup(&udev_monitor->filter_property_list);
+        free(udev_monitor->rx);
         free(udev_monitor);
         return NULL;
 }
@@ -549,140 +704,140 @@ static int passes_filter(struct udev_monitor *udev_monitor, struct udev_device *
 
 tag:
         if (udev_list_get_entry(&udev_monitor->filter_tag_list) == NULL)
-                return 1;
+                goto sysname;
         udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_tag_list)) {
                 const char *tag = udev_list_entry_get_name(list_entry);
 
                 if (udev_device_has_tag(udev_device, tag))
+                        goto sysname;
+        }
+        return 0;
+
+sysname:
+        if (udev_list_get_entry(&udev_monitor->filter_sysname_list) == NULL)
+                goto property;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_sysname_list)) {
+                const char *sysname = udev_list_entry_get_name(list_entry);
+
+                if (fnmatch(sysname, udev_device_get_sysname(udev_device), 0) == 0)
+                        goto property;
+        }
+        return 0;
+
+property:
+        if (udev_list_get_entry(&udev_monitor->filter_property_list) == NULL)
+                return 1;
+        udev_list_entry_foreach(list_entry, udev_list_get_entry(&udev_monitor->filter_property_list)) {
+                const char *value;
+
+                value = udev_device_get_property_value(udev_device, udev_list_entry_get_name(list_entry));
+                if (value == NULL)
+                        continue;
+                if (fnmatch(udev_list_entry_get_value(list_entry), value, 0) == 0)
                         return 1;
         }
         return 0;
 }
 
-/**
- * udev_monitor_receive_device:
- * @udev_monitor: udev monitor
- *
- * Receive data from the udev monitor socket, allocate a new udev
- * device, fill in the received data, and return the device.
- *
- * Only socket connections with uid=0 are accepted.
- *
- * The monitor socket is by default set to NONBLOCK. A variant of poll() on
- * the file descriptor returned by udev_monitor_get_fd() should to be used to
- * wake up when new devices arrive, or alternatively the file descriptor
- * switched into blocking mode.
- *
- * The initial refcount is 1, and needs to be decremented to
- * release the resources of the udev device.
- *
- * Returns: a new udev device, or #NULL, in case of an error
- **/
-_public_ struct udev_device *udev_monitor_receive_device(struct udev_monitor *udev_monitor)
+union monitor_buffer {
+        struct udev_monitor_netlink_header nlh;
+        char raw[8192];
+};
+
+/* buffers of a batched receive, allocated with the first call */
+#define UDEV_MONITOR_BATCH_MAX 32
+struct udev_monitor_rx {
+        struct mmsghdr msgs[UDEV_MONITOR_BATCH_MAX];
+        struct iovec iov[UDEV_MONITOR_BATCH_MAX];
+        union sockaddr_union snl[UDEV_MONITOR_BATCH_MAX];
+        char cred_msg[UDEV_MONITOR_BATCH_MAX][CMSG_SPACE(sizeof(struct ucred))];
+        union monitor_buffer buf[UDEV_MONITOR_BATCH_MAX];
+};
+
+/*
+ * Check a received message and create the device from it. Returns 1 and
+ * the device, 0 if the device does not pass the filter, or a negative
+ * error value if the message is not valid.
+ */
+static int monitor_parse_message(struct udev_monitor *udev_monitor, struct msghdr *smsg,
+                                 union monitor_buffer *buf, ssize_t buflen,
+                                 struct udev_device **ret)
 {
+        union sockaddr_union *snl = smsg->msg_name;
         struct udev_device *udev_device;
-        struct msghdr smsg;
-        struct iovec iov;
-        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
         struct cmsghdr *cmsg;
-        union sockaddr_union snl;
         struct ucred *cred;
-        union {
-                struct udev_monitor_netlink_header nlh;
-                char raw[8192];
-        } buf;
-        ssize_t buflen;
         ssize_t bufpos;
         bool is_initialized = false;
 
-retry:
-        if (udev_monitor == NULL)
-                return NULL;
-        iov.iov_base = &buf;
-        iov.iov_len = sizeof(buf);
-        memzero(&smsg, sizeof(struct msghdr));
-        smsg.msg_iov = &iov;
-        smsg.msg_iovlen = 1;
-        smsg.msg_control = cred_msg;
-        smsg.msg_controllen = sizeof(cred_msg);
-        smsg.msg_name = &snl;
-        smsg.msg_namelen = sizeof(snl);
-
-        buflen = recvmsg(udev_monitor->sock, &smsg, 0);
-        if (buflen < 0) {
-                if (errno != EINTR)
-                        log_debug("unable to receive message");
-                return NULL;
-        }
-
-        if (buflen < 32 || (smsg.msg_flags & MSG_TRUNC)) {
+        if (buflen < 32 || (smsg->msg_flags & MSG_TRUNC)) {
                 log_debug("invalid message length");
-                return NULL;
+                return -EINVAL;
         }
 
-        if (snl.nl.nl_groups == 0) {
+        if (snl->nl.nl_groups == 0) {
                 /* unicast message, check if we trust the sender */
                 if (udev_monitor->snl_trusted_sender.nl.nl_pid == 0 ||
-                    snl.nl.nl_pid != udev_monitor->snl_trusted_sender.nl.nl_pid) {
+                    snl->nl.nl_pid != udev_monitor->snl_trusted_sender.nl.nl_pid) {
                         log_debug("unicast netlink message ignored");
-                        return NULL;
+                        return -EPERM;
                 }
-        } else if (snl.nl.nl_groups == UDEV_MONITOR_KERNEL) {
-                if (snl.nl.nl_pid > 0) {
+        } else if (snl->nl.nl_groups == UDEV_MONITOR_KERNEL) {
+                if (snl->nl.nl_pid > 0) {
                         log_debug("multicast kernel netlink message from PID %"PRIu32" ignored",
-                                  snl.nl.nl_pid);
-                        return NULL;
+                                  snl->nl.nl_pid);
+                        return -EPERM;
                 }
         }
 
-        cmsg = CMSG_FIRSTHDR(&smsg);
+        cmsg = CMSG_FIRSTHDR(smsg);
         if (cmsg == NULL || cmsg->cmsg_type != SCM_CREDENTIALS) {
                 log_debug("no sender credentials received, message ignored");
-                return NULL;
+                return -EPERM;
         }
 
         cred = (struct ucred *)CMSG_DATA(cmsg);
         if (cred->uid != 0) {
                 log_debug("sender uid="UID_FMT", message ignored", cred->uid);
-                return NULL;
+                return -EPERM;
         }
 
-        if (memcmp(buf.raw, "libudev", 8) == 0) {
+        if (memcmp(buf->raw, "libudev", 8) == 0) {
                 /* udev message needs proper version magic */
-                if (buf.nlh.magic != htonl(UDEV_MONITOR_MAGIC)) {
+                if (buf->nlh.magic != htonl(UDEV_MONITOR_MAGIC)) {
                         log_debug("unrecognized message signature (%x != %x)",
-                                 buf.nlh.magic, htonl(UDEV_MONITOR_MAGIC));
-                        return NULL;
+                                 buf->nlh.magic, htonl(UDEV_MONITOR_MAGIC));
+                        return -EINVAL;
                 }
-                if (buf.nlh.properties_off+32 > (size_t)buflen) {
+                if (buf->nlh.properties_off+32 > (size_t)buflen) {
                         log_debug("message smaller than expected (%u > %zd)",
-                                  buf.nlh.properties_off+32, buflen);
-                        return NULL;
+                                  buf->nlh.properties_off+32, buflen);
+                        return -EINVAL;
                 }
 
-                bufpos = buf.nlh.properties_off;
+                bufpos = buf->nlh.properties_off;
 
                 /* devices received from udev are always initialized */
                 is_initialized = true;
         } else {
                 /* kernel message with header */
-                bufpos = strlen(buf.raw) + 1;
+                bufpos = strlen(buf->raw) + 1;
                 if ((size_t)bufpos < sizeof("a@/d") || bufpos >= buflen) {
                         log_debug("invalid message length");
-                        return NULL;
+                        return -EINVAL;
                 }
 
                 /* check message header */
-                if (strstr(buf.raw, "@/") == NULL) {
+                if (strstr(buf->raw, "@/") == NULL) {
                         log_debug("unrecognized message header");
-                        return NULL;
+                        return -EINVAL;
                 }
         }
 
-        udev_device = udev_device_new_from_nulstr(udev_monitor->udev, &buf.raw[bufpos], buflen - bufpos);
+        udev_device = udev_device_new_from_nulstr(udev_monitor->udev, &buf->raw[bufpos], buflen - bufpos);
         if (!udev_device) {
                 log_debug("could not create device: %m");
-                return NULL;
+                return -ENOMEM;
         }
 
         if (is_initialized)
@@ -690,11 +845,71 @@ retry:
 
         /* skip device, if it does not pass the current filter */
         if (!passes_filter(udev_monitor, udev_device)) {
+                udev_device_unref(udev_device);
+                return 0;
+        }
+
+        *ret = udev_device;
+        return 1;
+}
+
+/**
+ * udev_monitor_receive_device:
+ * @udev_monitor: udev monitor
+ *
+ * Receive data from the udev monitor socket, allocate a new udev
+ * device, fill in the received data, and return the device.
+ *
+ * Only socket connections with uid=0 are accepted.
+ *
+ * The monitor socket is by default set to NONBLOCK. A variant of poll() on
+ * the file descriptor returned by udev_monitor_get_fd() should to be used to
+ * wake up when new devices arrive, or alternatively the file descriptor
+ * switched into blocking mode.
+ *
+ * The initial refcount is 1, and needs to be decremented to
+ * release the resources of the udev device.
+ *
+ * Returns: a new udev device, or #NULL, in case of an error
+ **/
+_public_ struct udev_device *udev_monitor_receive_device(struct udev_monitor *udev_monitor)
+{
+        struct udev_device *udev_device;
+        struct msghdr smsg;
+        struct iovec iov;
+        char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
+        union sockaddr_union snl;
+        union monitor_buffer buf;
+        ssize_t buflen;
+        int r;
+
+retry:
+        if (udev_monitor == NULL)
+                return NULL;
+        iov.iov_base = &buf;
+        iov.iov_len = sizeof(buf);
+        memzero(&smsg, sizeof(struct msghdr));
+        smsg.msg_iov = &iov;
+        smsg.msg_iovlen = 1;
+        smsg.msg_control = cred_msg;
+        smsg.msg_controllen = sizeof(cred_msg);
+        smsg.msg_name = &snl;
+        smsg.msg_namelen = sizeof(snl);
+
+        buflen = recvmsg(udev_monitor->sock, &smsg, 0);
+        if (buflen < 0) {
+                if (errno != EINTR)
+                        log_debug("unable to receive message");
+                return NULL;
+        }
+
+        r = monitor_parse_message(udev_monitor, &smsg, &buf, buflen, &udev_device);
+        if (r < 0)
+                return NULL;
+        if (r == 0) {
                 struct pollfd pfd[1];
                 int rc;
 
-                udev_device_unref(udev_device);
-
                 /* if something is queued, get next device */
                 pfd[0].fd = udev_monitor->sock;
                 pfd[0].events = POLLIN;
@@ -707,6 +922,97 @@ retry:
         return udev_device;
 }
 
+/**
+ * udev_monitor_receive_devices:
+ * @udev_monitor: udev monitor
+ * @devices: array to store the received devices in
+ * @n_devices: size of the array
+ *
+ * Receive up to @n_devices devices from the udev monitor socket. Like
+ * udev_monitor_receive_device(), but all queued messages are read with
+ * as few system calls as possible. If the socket is in blocking mode,
+ * the call waits for the first message only.
+ *
+ * Every returned device has an initial refcount of 1, which needs to be
+ * decremented to release the resources of the udev device.
+ *
+ * Returns: the number of devices stored in @devices, which is 0 if no
+ * pending message passed the filter, or a negative error value. -EAGAIN
+ * is returned if no message is queued, -ENOBUFS if messages were lost
+ * because the socket receive buffer overflowed.
+ **/
+_public_ int udev_monitor_receive_devices(struct udev_monitor *udev_monitor,
+                                          struct udev_device **devices, unsigned int n_devices)
+{
+        struct udev_monitor_rx *rx;
+        unsigned int n = 0;
+        int flags = MSG_WAITFORONE;
+
+        if (udev_monitor == NULL || devices == NULL)
+                return -EINVAL;
+
+        /* an error hit after devices were already received is reported with the next call */
+        if (udev_monitor->rx_error < 0) {
+                int r = udev_monitor->rx_error;
+
+                udev_monitor->rx_error = 0;
+                return r;
+        }
+
+        if (udev_monitor->rx == NULL) {
+                udev_monitor->rx = new(struct udev_monitor_rx, 1);
+                if (udev_monitor->rx == NULL)
+                        return -ENOMEM;
+        }
+        rx = udev_monitor->rx;
+
+        while (n < n_devices) {
+                unsigned int vlen = MIN(n_devices - n, (unsigned int) UDEV_MONITOR_BATCH_MAX);
+                unsigned int i;
+                int count;
+
+                for (i = 0; i < vlen; i++) {
+                        rx->iov[i].iov_base = &rx->buf[i];
+                        rx->iov[i].iov_len = sizeof(rx->buf[i]);
+                        memzero(&rx->msgs[i], sizeof(struct mmsghdr));
+                        rx->msgs[i].msg_hdr.msg_iov = &rx->iov[i];
+                        rx->msgs[i].msg_hdr.msg_iovlen = 1;
+                        rx->msgs[i].msg_hdr.msg_control = rx->cred_msg[i];
+                        rx->msgs[i].msg_hdr.msg_controllen = sizeof(rx->cred_msg[i]);
+                        rx->msgs[i].msg_hdr.msg_name = &rx->snl[i];
+                        rx->msgs[i].msg_hdr.msg_namelen = sizeof(rx->snl[i]);
+                }
+
+                count = recvmmsg(udev_monitor->sock, rx->msgs, vlen, flags, NULL);
+                if (count < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == EAGAIN && n > 0)
+                                break;
+                        if (n > 0) {
+                                udev_monitor->rx_error = -errno;
+                                break;
+                        }
+                        if (errno != EAGAIN)
+                                log_debug_errno(errno, "unable to receive messages: %m");
+                        return -errno;
+                }
+
+                for (i = 0; i < (unsigned int) count; i++) {
+                        if (monitor_parse_message(udev_monitor, &rx->msgs[i].msg_hdr, &rx->buf[i],
+                                                  rx->msgs[i].msg_len, &devices[n]) > 0)
+                                n++;
+                }
+
+                /* the queue is drained */
+                if ((unsigned int) count < vlen)
+                        break;
+                flags = MSG_DONTWAIT;
+        }
+
+        return n;
+}
+
 int udev_monitor_send_device(struct udev_monitor *udev_monitor,
                              struct udev_monitor *destination, struct udev_device *udev_device)
 {
@@ -726,6 +1032,8 @@ int udev_monitor_send_device(struct udev_monitor *udev_monitor,
         };
         struct udev_list_entry *list_entry;
         uint64_t tag_bloom_bits;
+        uint64_t property_bloom_bits;
+        unsigned int k;
 
         blen = udev_device_get_properties_monitor_buf(udev_device, &buf);
         if (blen < 32) {
@@ -750,6 +1058,22 @@ int udev_monitor_send_device(struct udev_monitor *udev_monitor,
                 nlh.filter_tag_bloom_lo = htonl(tag_bloom_bits & 0xffffffff);
         }
 
+        val = udev_device_get_sysname(udev_device);
+        if (val != NULL)
+                nlh.filter_sysname_hash = htonl(util_string_hash32(val));
+
+        /* add property bloom filter */
+        property_bloom_bits = 0;
+        for (k = 0; k < ELEMENTSOF(filter_property_keys); k++) {
+                val = udev_device_get_property_value(udev_device, filter_property_keys[k]);
+                if (val != NULL)
+                        property_bloom_bits |= property_bloom64(filter_property_keys[k], val);
+        }
+        if (property_bloom_bits > 0) {
+                nlh.filter_property_bloom_hi = htonl(property_bloom_bits >> 32);
+                nlh.filter_property_bloom_lo = htonl(property_bloom_bits & 0xffffffff);
+        }
+
         /* add properties list */
         nlh.properties_off = iov[0].iov_len;
         nlh.properties_len = blen;
@@ -827,6 +1151,57 @@ _public_ int udev_monitor_filter_add_match_tag(struct udev_monitor *udev_monitor
         return 0;
 }
 
+/**
+ * udev_monitor_filter_add_match_sysname:
+ * @udev_monitor: the monitor
+ * @sysname: the sysname or a shell glob pattern to match the incoming devices against
+ *
+ * An exact sysname is matched inside the kernel, and libudev subscribers
+ * will usually not be woken up for devices which do not match. Glob
+ * patterns are matched in the library.
+ *
+ * The filter must be installed before the monitor is switched to listening mode.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ */
+_public_ int udev_monitor_filter_add_match_sysname(struct udev_monitor *udev_monitor, const char *sysname)
+{
+        if (udev_monitor == NULL)
+                return -EINVAL;
+        if (sysname == NULL)
+                return -EINVAL;
+        if (udev_list_entry_add(&udev_monitor->filter_sysname_list, sysname, NULL) == NULL)
+                return -ENOMEM;
+        return 0;
+}
+
+/**
+ * udev_monitor_filter_add_match_property:
+ * @udev_monitor: the monitor
+ * @property: the property key
+ * @value: the value or a shell glob pattern to match the incoming devices against
+ *
+ * Exact values of the properties ID_SERIAL, ID_SERIAL_SHORT, ID_PATH,
+ * ID_FS_UUID, ID_FS_LABEL, DM_NAME and DM_UUID are matched inside the
+ * kernel, and libudev subscribers will usually not be woken up for
+ * devices which do not match. All other matches are done in the library.
+ * A device matches if it matches any of the property matches.
+ *
+ * The filter must be installed before the monitor is switched to listening mode.
+ *
+ * Returns: 0 on success, otherwise a negative error value.
+ */
+_public_ int udev_monitor_filter_add_match_property(struct udev_monitor *udev_monitor, const char *property, const char *value)
+{
+        if (udev_monitor == NULL)
+                return -EINVAL;
+        if (property == NULL || value == NULL)
+                return -EINVAL;
+        if (udev_list_entry_add(&udev_monitor->filter_property_list, property, value) == NULL)
+                return -ENOMEM;
+        return 0;
+}
+
 /**
  * udev_monitor_filter_remove:
  * @udev_monitor: monitor
@@ -840,5 +1215,7 @@ _public_ int udev_monitor_filter_remove(struct udev_monitor *udev_monitor)
         static struct sock_fprog filter = { 0, NULL };
 
         udev_list_cleanup(&udev_monitor->filter_subsystem_list);
+        udev_list_cleanup(&udev_monitor->filter_sysname_list);
+        udev_list_cleanup(&udev_monitor->filter_property_list);
         return setsockopt(udev_monitor->sock, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter));
 }
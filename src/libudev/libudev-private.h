@@ -28,12 +28,16 @@
 #include "util.h"
 #include "mkdir.h"
 #include "strxcpyx.h"
+#include "hashmap.h"
 
 #define READ_END  0
 #define WRITE_END 1
 
 /* libudev.c */
 int udev_get_rules_path(struct udev *udev, char **path[], usec_t *ts_usec[]);
+const char *udev_intern_name(struct udev *udev, const char *name);
+void *udev_alloc0(struct udev *udev, size_t size);
+void udev_free(struct udev *udev, void *p, size_t size);
 
 /* libudev-device.c */
 struct udev_device *udev_device_new_from_nulstr(struct udev *udev, char *nulstr, ssize_t buflen);
@@ -66,11 +70,37 @@ int udev_device_get_ifindex(struct udev_device *udev_device);
 void udev_device_set_info_loaded(struct udev_device *device);
 bool udev_device_get_db_persist(struct udev_device *udev_device);
 void udev_device_set_db_persist(struct udev_device *udev_device);
+int udev_device_read_sysattrs(struct udev_device *udev_device, char **sysattrs);
+void udev_device_forget_sysattr(struct udev_device *udev_device, const char *sysattr);
 
 /* libudev-device-private.c */
 int udev_device_update_db(struct udev_device *udev_device);
 int udev_device_delete_db(struct udev_device *udev_device);
 int udev_device_tag_index(struct udev_device *dev, struct udev_device *dev_old, bool add);
+int udev_device_property_index(struct udev_device *dev, struct udev_device *dev_old, bool add);
+int property_index_fill(char * const *keys);
+int tag_index_setup(void);
+void tag_index_invalidate(void);
+void tag_index_compact(struct udev *udev);
+
+/* libudev-tag-index.c */
+struct tag_index_entry {
+        const char *id;
+        const char *subsystem;
+        const char *devpath;
+};
+struct tag_index {
+        char *buf;
+        struct tag_index_entry *entries;
+        size_t entries_count;
+        /* lines in the file, including the replaced and removed ones */
+        size_t records;
+};
+int tag_index_load(const char *tag, struct tag_index **ret);
+int tag_index_load_fd(int fd, struct tag_index **ret);
+struct tag_index *tag_index_free(struct tag_index *index);
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct tag_index*, tag_index_free);
+#define _cleanup_tag_index_free_ _cleanup_(tag_index_freep)
 
 /* libudev-monitor.c - netlink/unix socket communication  */
 int udev_monitor_disconnect(struct udev_monitor *udev_monitor);
@@ -86,10 +116,15 @@ struct udev_list_node {
 struct udev_list {
         struct udev *udev;
         struct udev_list_node node;
-        struct udev_list_entry **entries;
-        unsigned int entries_cur;
-        unsigned int entries_max;
+        Hashmap *entries;
         bool unique;
+        bool unsorted;
+        /*
+         * entries are allocated from the context's pools, and their names
+         * shared through it, see udev_intern_name(); the owner of the list
+         * must hold a reference to the context
+         */
+        bool interned;
 };
 #define UDEV_LIST(list) struct udev_list_node list = { &(list), &(list) }
 void udev_list_node_init(struct udev_list_node *list);
@@ -107,6 +142,7 @@ void udev_list_node_remove(struct udev_list_node *entry);
 void udev_list_init(struct udev *udev, struct udev_list *list, bool unique);
 void udev_list_cleanup(struct udev_list *list);
 struct udev_list_entry *udev_list_get_entry(struct udev_list *list);
+struct udev_list_entry *udev_list_get_entry_by_name(struct udev_list *list, const char *name);
 struct udev_list_entry *udev_list_entry_add(struct udev_list *list, const char *name, const char *value);
 void udev_list_entry_delete(struct udev_list_entry *entry);
 int udev_list_entry_get_num(struct udev_list_entry *list_entry);
@@ -130,7 +166,29 @@ int udev_queue_export_device_queued(struct udev_queue_export *udev_queue_export,
 int udev_queue_export_device_finished(struct udev_queue_export *udev_queue_export, struct udev_device *udev_device);
 
 /* libudev-hwdb.c */
+struct udev_hwdb *udev_hwdb_new_from_path(struct udev *udev, const char *path);
 bool udev_hwdb_validate(struct udev_hwdb *hwdb);
+#define UDEV_HWDB_FANOUT_BUCKETS 9
+struct udev_hwdb_stats {
+        unsigned int version;
+        uint64_t file_size;
+        uint64_t nodes_len;
+        uint64_t strings_len;
+        uint64_t nodes;
+        uint64_t values;
+        /* nodes with a wildcard in their prefix, or a wildcard child */
+        uint64_t glob_nodes;
+        uint64_t glob_groups;
+        uint64_t glob_entries;
+        /* number of nodes from the root to the nodes with values */
+        unsigned int depth_max;
+        uint64_t depth_sum;
+        uint64_t value_nodes;
+        /* nodes with 0, 1, 2-3, 4-7, ... 128-255 children */
+        uint64_t fanout[UDEV_HWDB_FANOUT_BUCKETS];
+};
+int udev_hwdb_get_stats(struct udev_hwdb *hwdb, struct udev_hwdb_stats *stats);
+uint64_t udev_hwdb_get_nodes_visited(struct udev_hwdb *hwdb);
 
 /* libudev-util.c */
 #define UTIL_PATH_SIZE                      1024
@@ -141,6 +199,7 @@ ssize_t util_get_sys_core_link_value(struct udev *udev, const char *slink, const
 int util_resolve_sys_link(struct udev *udev, char *syspath, size_t size);
 int util_log_priority(const char *priority);
 size_t util_path_encode(const char *src, char *dest, size_t size);
+int util_property_index_encode(const char *value, char *value_enc, size_t size);
 void util_remove_trailing_chars(char *path, char c);
 int util_replace_whitespace(const char *str, char *to, size_t len);
 int util_replace_chars(char *str, const char *white);
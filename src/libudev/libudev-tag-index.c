@@ -0,0 +1,183 @@
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "libudev.h"
+#include "libudev-private.h"
+#include "hashmap.h"
+
+/*
+ * Besides the directories of the tag index, /run/udev/tags/<tag>/<id>,
+ * udevd keeps one file per tag in /run/udev/tags-index/<tag>, which lists
+ * the tagged devices with their subsystem and devpath. Devices are found
+ * without a directory entry and a database read per device.
+ *
+ * The file is a log of records, one per line, appended to by the workers:
+ *   +<id> <subsystem> <devpath>   the device got the tag, or moved
+ *   -<id>                         the device lost the tag
+ * A later record of a device replaces the earlier ones. A file is only ever
+ * replaced by rename(), under an exclusive flock(); the workers append under
+ * a shared one.
+ *
+ * An existing file lists all tagged devices. A worker which can not append
+ * its record deletes the file, and workers do not create missing files;
+ * enumerators read the directory of the tag instead then. udevd builds the
+ * missing files from the directories when it is idle, and compacts large
+ * ones. At startup it deletes the files with a truncated record, and after
+ * a killed worker, all of them.
+ */
+
+static int tag_index_parse(struct tag_index *index, size_t size) {
+        _cleanup_hashmap_free_ Hashmap *ids = NULL;
+        char *line, *next;
+        size_t lines = 0;
+        size_t i;
+
+        for (i = 0; i < size; i++)
+                if (index->buf[i] == '\n')
+                        lines++;
+
+        index->entries = new(struct tag_index_entry, lines);
+        if (lines > 0 && index->entries == NULL)
+                return -ENOMEM;
+
+        ids = hashmap_new(&string_hash_ops);
+        if (ids == NULL)
+                return -ENOMEM;
+
+        /* a last line without newline is still being written */
+        for (line = index->buf; (next = memchr(line, '\n', index->buf + size - line)); line = next + 1) {
+                struct tag_index_entry *e;
+                char *id, *subsystem, *devpath;
+
+                next[0] = '\0';
+                index->records++;
+
+                id = &line[1];
+                if (line[0] == '-') {
+                        e = hashmap_remove(ids, id);
+                        if (e != NULL)
+                                e->id = NULL;
+                        continue;
+                }
+                if (line[0] != '+')
+                        continue;
+
+                subsystem = strchr(id, ' ');
+                if (subsystem == NULL)
+                        continue;
+                subsystem[0] = '\0';
+                subsystem++;
+                devpath = strchr(subsystem, ' ');
+                if (devpath == NULL || devpath[1] != '/')
+                        continue;
+                devpath[0] = '\0';
+                devpath++;
+
+                e = hashmap_get(ids, id);
+                if (e == NULL) {
+                        e = &index->entries[index->entries_count++];
+                        if (hashmap_put(ids, id, e) < 0)
+                                return -ENOMEM;
+                }
+                e->id = id;
+                e->subsystem = subsystem;
+                e->devpath = devpath;
+        }
+
+        /* drop the removed devices */
+        for (i = 0, lines = 0; i < index->entries_count; i++)
+                if (index->entries[i].id != NULL)
+                        index->entries[lines++] = index->entries[i];
+        index->entries_count = lines;
+
+        return 0;
+}
+
+int tag_index_load_fd(int fd, struct tag_index **ret) {
+        struct tag_index *index;
+        struct stat st;
+        size_t size = 0;
+        int r;
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        index = new0(struct tag_index, 1);
+        if (index == NULL)
+                return -ENOMEM;
+
+        /* appends might grow the file while it is read */
+        index->buf = malloc(st.st_size + 1);
+        if (index->buf == NULL) {
+                tag_index_free(index);
+                return -ENOMEM;
+        }
+        while (size < (size_t) st.st_size) {
+                ssize_t l;
+
+                l = pread(fd, index->buf + size, st.st_size - size, size);
+                if (l < 0) {
+                        r = -errno;
+                        tag_index_free(index);
+                        return r;
+                }
+                if (l == 0)
+                        break;
+                size += l;
+        }
+        index->buf[size] = '\0';
+
+        r = tag_index_parse(index, size);
+        if (r < 0) {
+                tag_index_free(index);
+                return r;
+        }
+
+        *ret = index;
+        return 0;
+}
+
+/* returns -ENOENT if the tag has no index file */
+int tag_index_load(const char *tag, struct tag_index **ret) {
+        _cleanup_close_ int fd = -1;
+        char filename[UTIL_PATH_SIZE];
+
+        strscpyl(filename, sizeof(filename), UDEV_ROOT_RUN "/udev/tags-index/", tag, NULL);
+        fd = open(filename, O_RDONLY|O_CLOEXEC|O_NOFOLLOW);
+        if (fd < 0)
+                return -errno;
+
+        return tag_index_load_fd(fd, ret);
+}
+
+struct tag_index *tag_index_free(struct tag_index *index) {
+        if (index == NULL)
+                return NULL;
+        free(index->entries);
+        free(index->buf);
+        free(index);
+        return NULL;
+}
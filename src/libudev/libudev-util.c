@@ -205,6 +205,16 @@ size_t util_path_encode(const char *src, char *dest, size_t size)
         return j;
 }
 
+/* encode a property value to its directory name in the property index */
+int util_property_index_encode(const char *value, char *value_enc, size_t size)
+{
+        if (util_path_encode(value, value_enc, size) == 0)
+                return -EINVAL;
+        if (streq(value_enc, ".") || streq(value_enc, ".."))
+                return -EINVAL;
+        return 0;
+}
+
 void util_remove_trailing_chars(char *path, char c)
 {
         size_t len;
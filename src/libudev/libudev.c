@@ -30,6 +30,8 @@
 #include "libudev.h"
 #include "libudev-private.h"
 #include "missing.h"
+#include "set.h"
+#include "mempool.h"
 
 /**
  * SECTION:libudev
@@ -44,12 +46,18 @@
  *
  * Opaque object representing the library context.
  */
+static const size_t pool_sizes[] = { 96, 128, 192, 256, 384, 512 };
+
 struct udev {
         int refcount;
         void (*log_fn)(struct udev *udev,
                        int priority, const char *file, int line, const char *fn,
                        const char *format, va_list args);
         void *userdata;
+        /* property, attribute and tag names shared by all objects of the context */
+        Set *names;
+        /* small objects of the context, by size class */
+        struct mempool pools[ELEMENTSOF(pool_sizes)];
 };
 
 /**
@@ -93,12 +101,17 @@ _public_ void udev_set_userdata(struct udev *udev, void *userdata) {
  **/
 _public_ struct udev *udev_new(void) {
         struct udev *udev;
+        unsigned int i;
         _cleanup_fclose_ FILE *f = NULL;
 
         udev = new0(struct udev, 1);
         if (udev == NULL)
                 return NULL;
         udev->refcount = 1;
+        for (i = 0; i < ELEMENTSOF(pool_sizes); i++) {
+                udev->pools[i].tile_size = pool_sizes[i];
+                udev->pools[i].at_least = 16;
+        }
 
         f = fopen( UDEV_CONF_FILE, "re");
         if (f != NULL) {
@@ -204,15 +217,89 @@ _public_ struct udev *udev_ref(struct udev *udev) {
  * Returns: the passed udev library context if it has still an active reference, or #NULL otherwise.
  **/
 _public_ struct udev *udev_unref(struct udev *udev) {
+        unsigned int i;
+
         if (udev == NULL)
                 return NULL;
         udev->refcount--;
         if (udev->refcount > 0)
                 return udev;
+        set_free_free(udev->names);
+        for (i = 0; i < ELEMENTSOF(pool_sizes); i++)
+                mempool_drop(&udev->pools[i]);
         free(udev);
         return NULL;
 }
 
+static struct mempool *udev_get_pool(struct udev *udev, size_t size)
+{
+        unsigned int i;
+
+        for (i = 0; i < ELEMENTSOF(pool_sizes); i++)
+                if (size <= pool_sizes[i])
+                        return &udev->pools[i];
+        return NULL;
+}
+
+/*
+ * Allocate a zeroed object from the context's pools, for objects which
+ * keep a reference to the context. Objects larger than the largest size
+ * class are allocated individually. The caller passes the same size to
+ * udev_free().
+ */
+void *udev_alloc0(struct udev *udev, size_t size)
+{
+        struct mempool *mp;
+
+        mp = udev_get_pool(udev, size);
+        if (mp == NULL)
+                return malloc0(size);
+        return mempool_alloc0_tile(mp);
+}
+
+void udev_free(struct udev *udev, void *p, size_t size)
+{
+        struct mempool *mp;
+
+        if (p == NULL)
+                return;
+
+        mp = udev_get_pool(udev, size);
+        if (mp == NULL)
+                free(p);
+        else
+                mempool_free_tile(mp, p);
+}
+
+/*
+ * Return the context's copy of a name; the returned string lives as
+ * long as the context. Only for names from a bounded set: property,
+ * attribute and tag names, not paths or values.
+ */
+const char *udev_intern_name(struct udev *udev, const char *name)
+{
+        char *n;
+        int r;
+
+        n = set_get(udev->names, (char *) name);
+        if (n != NULL)
+                return n;
+
+        r = set_ensure_allocated(&udev->names, &string_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        n = strdup(name);
+        if (n == NULL)
+                return NULL;
+
+        r = set_consume(udev->names, n);
+        if (r < 0)
+                return NULL;
+
+        return n;
+}
+
 /**
  * udev_set_log_fn:
  * @udev: udev library context
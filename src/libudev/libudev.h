@@ -127,10 +127,14 @@ int udev_monitor_enable_receiving(struct udev_monitor *udev_monitor);
 int udev_monitor_set_receive_buffer_size(struct udev_monitor *udev_monitor, int size);
 int udev_monitor_get_fd(struct udev_monitor *udev_monitor);
 struct udev_device *udev_monitor_receive_device(struct udev_monitor *udev_monitor);
+int udev_monitor_receive_devices(struct udev_monitor *udev_monitor,
+                                 struct udev_device **devices, unsigned int n_devices);
 /* in-kernel socket filters to select messages that get delivered to a listener */
 int udev_monitor_filter_add_match_subsystem_devtype(struct udev_monitor *udev_monitor,
                                                     const char *subsystem, const char *devtype);
 int udev_monitor_filter_add_match_tag(struct udev_monitor *udev_monitor, const char *tag);
+int udev_monitor_filter_add_match_sysname(struct udev_monitor *udev_monitor, const char *sysname);
+int udev_monitor_filter_add_match_property(struct udev_monitor *udev_monitor, const char *property, const char *value);
 int udev_monitor_filter_update(struct udev_monitor *udev_monitor);
 int udev_monitor_filter_remove(struct udev_monitor *udev_monitor);
 
@@ -155,12 +159,49 @@ int udev_enumerate_add_match_tag(struct udev_enumerate *udev_enumerate, const ch
 int udev_enumerate_add_match_parent(struct udev_enumerate *udev_enumerate, struct udev_device *parent);
 int udev_enumerate_add_match_is_initialized(struct udev_enumerate *udev_enumerate);
 int udev_enumerate_add_syspath(struct udev_enumerate *udev_enumerate, const char *syspath);
+int udev_enumerate_set_scan_threads(struct udev_enumerate *udev_enumerate, unsigned int n_threads);
 /* run enumeration with active filters */
 int udev_enumerate_scan_devices(struct udev_enumerate *udev_enumerate);
 int udev_enumerate_scan_subsystems(struct udev_enumerate *udev_enumerate);
+/* run enumeration and pass every matching device to a callback, unsorted */
+int udev_enumerate_scan_devices_stream(struct udev_enumerate *udev_enumerate,
+                                       int (*cb)(struct udev_enumerate *udev_enumerate,
+                                                 struct udev_device *udev_device,
+                                                 void *userdata),
+                                       void *userdata);
 /* return device list */
 struct udev_list_entry *udev_enumerate_get_list_entry(struct udev_enumerate *udev_enumerate);
 
+/*
+ * udev_device_cache
+ *
+ * live view of the current devices, kept up to date by udev events
+ */
+struct udev_device_cache;
+struct udev_device_cache *udev_device_cache_ref(struct udev_device_cache *udev_device_cache);
+struct udev_device_cache *udev_device_cache_unref(struct udev_device_cache *udev_device_cache);
+struct udev *udev_device_cache_get_udev(struct udev_device_cache *udev_device_cache);
+struct udev_device_cache *udev_device_cache_new(struct udev *udev);
+int udev_device_cache_add_match_subsystem(struct udev_device_cache *udev_device_cache, const char *subsystem);
+int udev_device_cache_add_property_index(struct udev_device_cache *udev_device_cache, const char *property);
+int udev_device_cache_set_callback(struct udev_device_cache *udev_device_cache,
+                                   void (*cb)(struct udev_device_cache *udev_device_cache,
+                                              struct udev_device *udev_device,
+                                              const char *action,
+                                              void *userdata),
+                                   void *userdata);
+/* enumerate and start listening to events */
+int udev_device_cache_start(struct udev_device_cache *udev_device_cache);
+/* apply pending events when the file descriptor is readable */
+int udev_device_cache_get_fd(struct udev_device_cache *udev_device_cache);
+int udev_device_cache_process(struct udev_device_cache *udev_device_cache);
+/* lookups, devices are owned by the cache */
+struct udev_device *udev_device_cache_get_device_by_syspath(struct udev_device_cache *udev_device_cache, const char *syspath);
+struct udev_device *udev_device_cache_get_device_by_devnum(struct udev_device_cache *udev_device_cache, char type, dev_t devnum);
+struct udev_list_entry *udev_device_cache_get_devices_by_property(struct udev_device_cache *udev_device_cache,
+                                                                  const char *property, const char *value);
+struct udev_list_entry *udev_device_cache_get_list_entry(struct udev_device_cache *udev_device_cache);
+
 /*
  * udev_queue
  *
@@ -192,6 +233,13 @@ struct udev_hwdb *udev_hwdb_new(struct udev *udev);
 struct udev_hwdb *udev_hwdb_ref(struct udev_hwdb *hwdb);
 struct udev_hwdb *udev_hwdb_unref(struct udev_hwdb *hwdb);
 struct udev_list_entry *udev_hwdb_get_properties_list_entry(struct udev_hwdb *hwdb, const char *modalias, unsigned int flags);
+int udev_hwdb_lookup(struct udev_hwdb *hwdb, const char *modalias);
+const char *udev_hwdb_get_property_name(struct udev_hwdb *hwdb, unsigned int index);
+const char *udev_hwdb_get_property_value(struct udev_hwdb *hwdb, unsigned int index);
+int udev_hwdb_lookup_batch(struct udev_hwdb *hwdb, const char * const *modaliases, size_t n,
+                           int (*cb)(struct udev_hwdb *hwdb, size_t index,
+                                     struct udev_list_entry *list, void *userdata),
+                           void *userdata);
 
 /*
  * udev_util
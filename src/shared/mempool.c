@@ -88,8 +88,6 @@ void mempool_free_tile(struct mempool *mp, void *p) {
         mp->freelist = p;
 }
 
-#ifdef VALGRIND
-
 void mempool_drop(struct mempool *mp) {
         struct pool *p = mp->first_pool;
         while (p) {
@@ -99,5 +97,3 @@ void mempool_drop(struct mempool *mp) {
                 p = n;
         }
 }
-
-#endif
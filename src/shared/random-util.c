@@ -31,7 +31,7 @@
 #include "util.h"
 
 int dev_urandom(void *p, size_t n) {
-        static int have_syscall = -1;
+        static thread_local int have_syscall = -1;
 
         _cleanup_close_ int fd = -1;
         int r;
@@ -30,6 +30,34 @@
 #include <blkid/blkid.h>
 
 #include "udev.h"
+#include "hashmap.h"
+#include "siphash24.h"
+
+/*
+ * Partition entry details (PART_ENTRY_*) of a partition come from the
+ * partition table of the whole disk. Instead of letting libblkid open
+ * and parse the whole disk for every single partition, the parsed table
+ * is kept per worker, keyed by the devnum of the disk. It is only kept
+ * for tables which are entirely in the first sectors of the disk, a GPT
+ * header carries the checksum of its entries; the hash of these sectors
+ * is compared before every use of the cached table. Other tables are
+ * remembered without entries, and probed for every partition.
+ */
+struct ptable_entry {
+        int partno;
+        uint64_t start;
+        uint64_t size;
+        char **properties;
+};
+
+struct ptable {
+        dev_t devnum;
+        uint8_t label_hash[8];
+        struct ptable_entry *entries;
+        unsigned int entries_cur;
+};
+
+static Hashmap *ptables;
 
 static void print_property(struct udev_device *dev, bool test, const char *name, const char *value) {
         char s[256];
@@ -99,7 +127,226 @@ static void print_property(struct udev_device *dev, bool test, const char *name,
         }
 }
 
-static int probe_superblocks(blkid_probe pr) {
+static struct ptable *ptable_free(struct ptable *t) {
+        unsigned int i;
+
+        if (!t)
+                return NULL;
+
+        for (i = 0; i < t->entries_cur; i++)
+                strv_free(t->entries[i].properties);
+        free(t->entries);
+        free(t);
+        return NULL;
+}
+
+static void ptable_forget(dev_t devnum) {
+        ptable_free(hashmap_remove(ptables, &devnum));
+}
+
+/* the first sectors of the disk hold a MBR, and a GPT header with up to 4k sectors */
+#define PTABLE_LABEL_SIZE (2 * 4096)
+
+static int ptable_label_hash(int fd, uint8_t hash[8]) {
+        static const uint8_t key[16] = "udev-ptable-hash";
+        _cleanup_free_ char *buf = NULL;
+        ssize_t len;
+
+        buf = malloc(PTABLE_LABEL_SIZE);
+        if (!buf)
+                return -ENOMEM;
+        len = pread(fd, buf, PTABLE_LABEL_SIZE, 0);
+        if (len < 0)
+                return -errno;
+
+        siphash24(hash, buf, len, key);
+        return 0;
+}
+
+static int ptable_entry_add_property(struct ptable_entry *e, const char *name, const char *fmt, ...) _printf_(3, 4);
+static int ptable_entry_add_property(struct ptable_entry *e, const char *name, const char *fmt, ...) {
+        _cleanup_free_ char *value = NULL;
+        va_list ap;
+        int r;
+
+        va_start(ap, fmt);
+        r = vasprintf(&value, fmt, ap);
+        va_end(ap);
+        if (r < 0)
+                return -ENOMEM;
+
+        if (strv_extend(&e->properties, name) < 0 ||
+            strv_extend(&e->properties, value) < 0)
+                return -ENOMEM;
+        return 0;
+}
+
+/* the same set and format of values libblkid sets for BLKID_PARTS_ENTRY_DETAILS */
+static int ptable_entry_fill(struct ptable_entry *e, blkid_partition par, dev_t devnum) {
+        const char *v;
+        int r = 0;
+
+        e->partno = blkid_partition_get_partno(par);
+        e->start = blkid_partition_get_start(par);
+        e->size = blkid_partition_get_size(par);
+
+        v = blkid_parttable_get_type(blkid_partition_get_table(par));
+        if (v)
+                r |= ptable_entry_add_property(e, "PART_ENTRY_SCHEME", "%s", v);
+        v = blkid_partition_get_name(par);
+        if (v)
+                r |= ptable_entry_add_property(e, "PART_ENTRY_NAME", "%s", v);
+        v = blkid_partition_get_uuid(par);
+        if (v)
+                r |= ptable_entry_add_property(e, "PART_ENTRY_UUID", "%s", v);
+        v = blkid_partition_get_type_string(par);
+        if (v)
+                r |= ptable_entry_add_property(e, "PART_ENTRY_TYPE", "%s", v);
+        else
+                r |= ptable_entry_add_property(e, "PART_ENTRY_TYPE", "0x%x", blkid_partition_get_type(par));
+        if (blkid_partition_get_flags(par))
+                r |= ptable_entry_add_property(e, "PART_ENTRY_FLAGS", "0x%llx", blkid_partition_get_flags(par));
+        r |= ptable_entry_add_property(e, "PART_ENTRY_NUMBER", "%d", e->partno);
+        r |= ptable_entry_add_property(e, "PART_ENTRY_OFFSET", "%"PRIu64, e->start);
+        r |= ptable_entry_add_property(e, "PART_ENTRY_SIZE", "%"PRIu64, e->size);
+        r |= ptable_entry_add_property(e, "PART_ENTRY_DISK", "%u:%u", major(devnum), minor(devnum));
+
+        return r < 0 ? -ENOMEM : 0;
+}
+
+static struct ptable *ptable_probe(struct udev_device *disk, int fd, const uint8_t label_hash[8]) {
+        struct ptable *t;
+        blkid_probe pr;
+        blkid_partlist ls;
+        blkid_parttable root;
+        const char *scheme;
+        int i, n;
+
+        pr = blkid_new_probe();
+        if (!pr)
+                return NULL;
+
+        t = NULL;
+        if (blkid_probe_set_device(pr, fd, 0, 0) < 0)
+                goto out;
+
+        blkid_probe_enable_superblocks(pr, 0);
+        blkid_probe_enable_partitions(pr, 1);
+        ls = blkid_probe_get_partitions(pr);
+        if (!ls)
+                goto out;
+
+        n = blkid_partlist_numof_partitions(ls);
+        if (n <= 0)
+                goto out;
+
+        t = new0(struct ptable, 1);
+        if (!t)
+                goto out;
+        t->devnum = udev_device_get_devnum(disk);
+        memcpy(t->label_hash, label_hash, sizeof(t->label_hash));
+
+        /* logical and nested partitions are described outside of the first sectors */
+        root = blkid_partlist_get_table(ls);
+        scheme = root ? blkid_parttable_get_type(root) : NULL;
+        if (!streq_ptr(scheme, "gpt") && !streq_ptr(scheme, "dos"))
+                goto out;
+        for (i = 0; i < n; i++) {
+                blkid_partition par;
+
+                par = blkid_partlist_get_partition(ls, i);
+                if (!par || blkid_partition_get_table(par) != root || blkid_partition_is_extended(par))
+                        goto out;
+        }
+
+        t->entries = new0(struct ptable_entry, n);
+        if (!t->entries) {
+                t = ptable_free(t);
+                goto out;
+        }
+
+        for (i = 0; i < n; i++) {
+                blkid_partition par;
+
+                par = blkid_partlist_get_partition(ls, i);
+                if (ptable_entry_fill(&t->entries[t->entries_cur++], par, t->devnum) < 0) {
+                        t = ptable_free(t);
+                        goto out;
+                }
+        }
+
+        log_debug("cached partition table of %s with %u entries",
+                  udev_device_get_devnode(disk), t->entries_cur);
+out:
+        blkid_free_probe(pr);
+        return t;
+}
+
+/* find the cached partition table entry matching the partition's geometry in sysfs */
+static const struct ptable_entry *ptable_lookup(struct udev_device *dev) {
+        _cleanup_close_ int fd = -1;
+        struct udev_device *disk;
+        uint8_t label_hash[8];
+        struct ptable *t;
+        dev_t devnum;
+        const char *attr;
+        int partno;
+        unsigned long long start, size;
+        unsigned int i;
+
+        disk = udev_device_get_parent(dev);
+        if (!disk || !streq_ptr(udev_device_get_devtype(disk), "disk"))
+                return NULL;
+        devnum = udev_device_get_devnum(disk);
+        if (major(devnum) == 0 || !udev_device_get_devnode(disk))
+                return NULL;
+
+        attr = udev_device_get_sysattr_value(dev, "partition");
+        if (!attr || safe_atoi(attr, &partno) < 0)
+                return NULL;
+        attr = udev_device_get_sysattr_value(dev, "start");
+        if (!attr || safe_atollu(attr, &start) < 0)
+                return NULL;
+        attr = udev_device_get_sysattr_value(dev, "size");
+        if (!attr || safe_atollu(attr, &size) < 0)
+                return NULL;
+
+        fd = open(udev_device_get_devnode(disk), O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return NULL;
+        if (ptable_label_hash(fd, label_hash) < 0)
+                return NULL;
+
+        t = hashmap_get(ptables, &devnum);
+        if (t && memcmp(t->label_hash, label_hash, sizeof(label_hash)) != 0) {
+                ptable_forget(devnum);
+                t = NULL;
+        }
+
+        if (!t) {
+                if (hashmap_ensure_allocated(&ptables, &devt_hash_ops) < 0)
+                        return NULL;
+
+                t = ptable_probe(disk, fd, label_hash);
+                if (!t)
+                        return NULL;
+
+                if (hashmap_put(ptables, &t->devnum, t) < 0) {
+                        ptable_free(t);
+                        return NULL;
+                }
+        }
+
+        for (i = 0; i < t->entries_cur; i++)
+                if (t->entries[i].partno == partno &&
+                    t->entries[i].start == start &&
+                    t->entries[i].size == size)
+                        return &t->entries[i];
+
+        return NULL;
+}
+
+static int probe_superblocks(blkid_probe pr, bool entry_details) {
         struct stat st;
         int rc;
 
@@ -125,7 +372,8 @@ static int probe_superblocks(blkid_probe pr) {
                         return 0;        /* partition table detected */
         }
 
-        blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+        if (entry_details)
+                blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
         blkid_probe_enable_superblocks(pr, 1);
 
         return blkid_do_safeprobe(pr);
@@ -139,6 +387,7 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
         const char *data;
         const char *name;
         const char *prtype = NULL;
+        const struct ptable_entry *entry = NULL;
         int nvals;
         int i;
         int err = 0;
@@ -193,7 +442,13 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                   udev_device_get_devnode(dev),
                   noraid ? "no" : "", offset);
 
-        err = probe_superblocks(pr);
+        /* a new event for the disk invalidates what we know about its partitions */
+        if (streq_ptr(udev_device_get_devtype(dev), "disk"))
+                ptable_forget(udev_device_get_devnum(dev));
+        else if (offset == 0 && streq_ptr(udev_device_get_devtype(dev), "partition"))
+                entry = ptable_lookup(dev);
+
+        err = probe_superblocks(pr, !entry);
         if (err < 0)
                 goto out;
         if (blkid_probe_has_value(pr, "SBBADCSUM")) {
@@ -214,6 +469,13 @@ static int builtin_blkid(struct udev_device *dev, int argc, char *argv[], bool t
                 print_property(dev, test, name, data);
         }
 
+        if (entry) {
+                char **p;
+
+                for (p = entry->properties; p && p[0] && p[1]; p += 2)
+                        print_property(dev, test, p[0], p[1]);
+        }
+
         blkid_free_probe(pr);
 out:
         if (err < 0)
@@ -222,9 +484,19 @@ out:
         return EXIT_SUCCESS;
 }
 
+/* called on udev shutdown and reload request */
+static void builtin_blkid_exit(struct udev *udev) {
+        struct ptable *t;
+
+        while ((t = hashmap_steal_first(ptables)))
+                ptable_free(t);
+        ptables = hashmap_free(ptables);
+}
+
 const struct udev_builtin udev_builtin_blkid = {
         .name = "blkid",
         .cmd = builtin_blkid,
+        .exit = builtin_blkid_exit,
         .help = "Filesystem and partition probing",
         .run_once = true,
 };
@@ -27,36 +27,135 @@
 #include <getopt.h>
 
 #include "udev.h"
+#include "hashmap.h"
 
 static struct udev_hwdb *hwdb;
 
+/*
+ * Identical lookup keys repeat across devices, like the ports of a hub,
+ * the CPUs, or several NICs of the same model. Keep the results of the
+ * most recently used keys, including the empty ones. The properties
+ * point into the mapped database, the cache is flushed before it is
+ * unmapped.
+ */
+#define HWDB_CACHE_MAX 512
+
+struct hwdb_cache_entry {
+        char *key;
+        /* property names and values, alternating */
+        const char **properties;
+        unsigned int properties_count;
+};
+
+/* ordered by use, the least recently used entry first */
+static OrderedHashmap *hwdb_cache;
+
+static void hwdb_cache_entry_free(struct hwdb_cache_entry *e) {
+        if (!e)
+                return;
+        free(e->key);
+        free(e->properties);
+        free(e);
+}
+
+static void hwdb_cache_flush(void) {
+        struct hwdb_cache_entry *e;
+
+        while ((e = ordered_hashmap_steal_first(hwdb_cache)))
+                hwdb_cache_entry_free(e);
+        ordered_hashmap_free(hwdb_cache);
+        hwdb_cache = NULL;
+}
+
+static struct hwdb_cache_entry *hwdb_cache_get(const char *key) {
+        struct hwdb_cache_entry *e;
+
+        e = ordered_hashmap_remove(hwdb_cache, key);
+        if (!e)
+                return NULL;
+
+        /* move to the end, as the most recently used */
+        if (ordered_hashmap_put(hwdb_cache, e->key, e) < 0) {
+                hwdb_cache_entry_free(e);
+                return NULL;
+        }
+        return e;
+}
+
+static struct hwdb_cache_entry *hwdb_cache_add(const char *key) {
+        struct hwdb_cache_entry *e;
+        unsigned int i;
+        int n;
+
+        if (!hwdb_cache) {
+                hwdb_cache = ordered_hashmap_new(&string_hash_ops);
+                if (!hwdb_cache)
+                        return NULL;
+        }
+
+        e = new0(struct hwdb_cache_entry, 1);
+        if (!e)
+                return NULL;
+        e->key = strdup(key);
+        if (!e->key)
+                goto fail;
+
+        n = udev_hwdb_lookup(hwdb, key);
+        if (n < 0)
+                goto fail;
+        if (n > 0) {
+                e->properties = new(const char *, n * 2);
+                if (!e->properties)
+                        goto fail;
+                for (i = 0; i < (unsigned int) n; i++) {
+                        e->properties[i * 2] = udev_hwdb_get_property_name(hwdb, i);
+                        e->properties[i * 2 + 1] = udev_hwdb_get_property_value(hwdb, i);
+                }
+                e->properties_count = n;
+        }
+
+        if (ordered_hashmap_size(hwdb_cache) >= HWDB_CACHE_MAX)
+                hwdb_cache_entry_free(ordered_hashmap_steal_first(hwdb_cache));
+        if (ordered_hashmap_put(hwdb_cache, e->key, e) < 0)
+                goto fail;
+        return e;
+fail:
+        hwdb_cache_entry_free(e);
+        return NULL;
+}
+
 int udev_builtin_hwdb_lookup(struct udev_device *dev,
                              const char *prefix, const char *modalias,
                              const char *filter, bool test) {
-        struct udev_list_entry *list;
-        struct udev_list_entry *entry;
+        char lookup[UTIL_LINE_SIZE];
+        struct hwdb_cache_entry *e;
+        unsigned int i;
         int n = 0;
 
         if (!hwdb)
                 return -ENOENT;
 
         if (prefix) {
-                _cleanup_free_ const char *lookup;
+                if (strscpyl(lookup, sizeof(lookup), prefix, modalias, NULL) == 0)
+                        return -ENAMETOOLONG;
+                modalias = lookup;
+        }
 
-                lookup = strjoin(prefix, modalias, NULL);
-                if (!lookup)
+        e = hwdb_cache_get(modalias);
+        if (!e) {
+                e = hwdb_cache_add(modalias);
+                if (!e)
                         return -ENOMEM;
-                list = udev_hwdb_get_properties_list_entry(hwdb, lookup, 0);
-        } else
-                list = udev_hwdb_get_properties_list_entry(hwdb, modalias, 0);
+        }
+
+        for (i = 0; i < e->properties_count; i++) {
+                const char *name = e->properties[i * 2];
+                const char *value = e->properties[i * 2 + 1];
 
-        udev_list_entry_foreach(entry, list) {
-                if (filter && fnmatch(filter, udev_list_entry_get_name(entry), FNM_NOESCAPE) != 0)
+                if (filter && fnmatch(filter, name, FNM_NOESCAPE) != 0)
                         continue;
 
-                if (udev_builtin_add_property(dev, test,
-                                              udev_list_entry_get_name(entry),
-                                              udev_list_entry_get_value(entry)) < 0)
+                if (udev_builtin_add_property(dev, test, name, value) < 0)
                         return -ENOMEM;
                 n++;
         }
@@ -200,12 +299,16 @@ static int builtin_hwdb_init(struct udev *udev) {
 
 /* called on udev shutdown and reload request */
 static void builtin_hwdb_exit(struct udev *udev) {
+        hwdb_cache_flush();
         hwdb = udev_hwdb_unref(hwdb);
 }
 
 /* called every couple of seconds during event activity; 'true' if config has changed */
 static bool builtin_hwdb_validate(struct udev *udev) {
-        return udev_hwdb_validate(hwdb);
+        if (!udev_hwdb_validate(hwdb))
+                return false;
+        hwdb_cache_flush();
+        return true;
 }
 
 const struct udev_builtin udev_builtin_hwdb = {
@@ -27,38 +27,172 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <libkmod.h>
 
 #include "udev.h"
 
 static struct kmod_ctx *ctx = NULL;
 
+/*
+ * During coldplug the same few aliases are requested over and over again.
+ * The result of resolving an alias is remembered in an anonymous shared
+ * mapping set up by the main daemon at init, which all workers inherit.
+ * Entries are only ever added; the whole table is dropped together with
+ * the module index when it is reloaded.
+ */
+#define KMOD_CACHE_SLOTS        2048
+#define KMOD_CACHE_PROBES       16
+#define KMOD_CACHE_ALIAS_MAX    192
+#define KMOD_CACHE_MODULES_MAX  64
+
+enum kmod_cache_state {
+        KMOD_CACHE_EMPTY,
+        KMOD_CACHE_BUSY,
+        /* no module matches the alias */
+        KMOD_CACHE_NO_MODULE,
+        /* all modules are built-in or blacklisted, nothing to do */
+        KMOD_CACHE_SATISFIED,
+        /* modules were inserted, nothing to do while they are still loaded */
+        KMOD_CACHE_LOADED,
+};
+
+struct kmod_cache_entry {
+        uint32_t state;
+        uint32_t hash;
+        char alias[KMOD_CACHE_ALIAS_MAX];
+        /* nulstr of module names, for KMOD_CACHE_LOADED */
+        char modules[KMOD_CACHE_MODULES_MAX];
+};
+
+static struct kmod_cache_entry *cache = NULL;
+
+static bool kmod_cache_modules_loaded(const char *modules) {
+        const char *m;
+
+        NULSTR_FOREACH(m, modules) {
+                char path[UTIL_PATH_SIZE];
+
+                strscpyl(path, sizeof(path), "/sys/module/", m, NULL);
+                if (access(path, F_OK) < 0)
+                        return false;
+        }
+
+        return true;
+}
+
+/* returns true if loading the alias can be skipped */
+static bool kmod_cache_lookup(const char *alias, uint32_t hash) {
+        unsigned int i;
+
+        if (!cache)
+                return false;
+
+        for (i = 0; i < KMOD_CACHE_PROBES; i++) {
+                struct kmod_cache_entry *e = &cache[(hash + i) % KMOD_CACHE_SLOTS];
+                uint32_t state = __atomic_load_n(&e->state, __ATOMIC_ACQUIRE);
+
+                if (state == KMOD_CACHE_EMPTY)
+                        return false;
+                if (state == KMOD_CACHE_BUSY || e->hash != hash || !streq(e->alias, alias))
+                        continue;
+
+                if (state == KMOD_CACHE_LOADED)
+                        return kmod_cache_modules_loaded(e->modules);
+
+                return true;
+        }
+
+        return false;
+}
+
+static void kmod_cache_add(const char *alias, uint32_t hash, enum kmod_cache_state state, const char *modules, size_t modules_len) {
+        unsigned int i;
+
+        if (!cache)
+                return;
+        if (strlen(alias) >= KMOD_CACHE_ALIAS_MAX || modules_len > KMOD_CACHE_MODULES_MAX)
+                return;
+
+        for (i = 0; i < KMOD_CACHE_PROBES; i++) {
+                struct kmod_cache_entry *e = &cache[(hash + i) % KMOD_CACHE_SLOTS];
+                uint32_t empty = KMOD_CACHE_EMPTY;
+
+                if (!__atomic_compare_exchange_n(&e->state, &empty, KMOD_CACHE_BUSY, false,
+                                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                        continue;
+
+                e->hash = hash;
+                strscpy(e->alias, sizeof(e->alias), alias);
+                if (modules_len > 0)
+                        memcpy(e->modules, modules, modules_len);
+                __atomic_store_n(&e->state, state, __ATOMIC_RELEASE);
+                return;
+        }
+}
+
 static int load_module(struct udev *udev, const char *alias) {
         struct kmod_list *list = NULL;
         struct kmod_list *l;
+        char modules[KMOD_CACHE_MODULES_MAX];
+        size_t modules_len = 0;
+        enum kmod_cache_state state;
+        bool cacheable = true;
+        uint32_t hash;
         int err;
 
+        hash = util_string_hash32(alias);
+        if (kmod_cache_lookup(alias, hash)) {
+                log_debug("Module for '%s' already handled", alias);
+                return 0;
+        }
+
         err = kmod_module_new_from_lookup(ctx, alias, &list);
         if (err < 0)
                 return err;
 
-        if (list == NULL)
+        if (list == NULL) {
                 log_debug("No module matches '%s'", alias);
+                kmod_cache_add(alias, hash, KMOD_CACHE_NO_MODULE, NULL, 0);
+                return err;
+        }
 
+        state = KMOD_CACHE_SATISFIED;
         kmod_list_foreach(l, list) {
                 struct kmod_module *mod = kmod_module_get_module(l);
+                const char *name = kmod_module_get_name(mod);
 
                 err = kmod_module_probe_insert_module(mod, KMOD_PROBE_APPLY_BLACKLIST, NULL, NULL, NULL, NULL);
                 if (err == KMOD_PROBE_APPLY_BLACKLIST)
-                        log_debug("Module '%s' is blacklisted", kmod_module_get_name(mod));
+                        log_debug("Module '%s' is blacklisted", name);
                 else if (err == 0)
-                        log_debug("Inserted '%s'", kmod_module_get_name(mod));
+                        log_debug("Inserted '%s'", name);
                 else
-                        log_debug("Failed to insert '%s'", kmod_module_get_name(mod));
+                        log_debug("Failed to insert '%s'", name);
+
+                /* failures are retried on the next request, just like before */
+                if (err < 0)
+                        cacheable = false;
+                else if (err == 0 && kmod_module_get_initstate(mod) != KMOD_MODULE_BUILTIN) {
+                        size_t len = strlen(name) + 1;
+
+                        /* keep one byte for the terminating empty string of the nulstr */
+                        if (modules_len + len < sizeof(modules)) {
+                                memcpy(modules + modules_len, name, len);
+                                modules_len += len;
+                                state = KMOD_CACHE_LOADED;
+                        } else
+                                cacheable = false;
+                }
 
                 kmod_module_unref(mod);
         }
 
+        if (cacheable) {
+                modules[modules_len++] = '\0';
+                kmod_cache_add(alias, hash, state, modules, modules_len);
+        }
+
         kmod_module_unref_list(list);
         return err;
 }
@@ -99,6 +233,14 @@ static int builtin_kmod_init(struct udev *udev) {
         log_debug("Load module index");
         kmod_set_log_fn(ctx, udev_kmod_log, udev);
         kmod_load_resources(ctx);
+
+        cache = mmap(NULL, sizeof(struct kmod_cache_entry) * KMOD_CACHE_SLOTS,
+                     PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+        if (cache == MAP_FAILED) {
+                log_debug_errno(errno, "Failed to allocate module alias cache: %m");
+                cache = NULL;
+        }
+
         return 0;
 }
 
@@ -106,6 +248,11 @@ static int builtin_kmod_init(struct udev *udev) {
 static void builtin_kmod_exit(struct udev *udev) {
         log_debug("Unload module index");
         ctx = kmod_unref(ctx);
+
+        if (cache) {
+                munmap(cache, sizeof(struct kmod_cache_entry) * KMOD_CACHE_SLOTS);
+                cache = NULL;
+        }
 }
 
 /* called every couple of seconds during event activity; 'true' if config has changed */
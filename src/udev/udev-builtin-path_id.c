@@ -29,8 +29,113 @@
 #include <errno.h>
 #include <dirent.h>
 #include <getopt.h>
+#include <sys/stat.h>
 
 #include "udev.h"
+#include "hashmap.h"
+
+/*
+ * The part of the path composed from a device upwards does not depend on
+ * the devices below it, so it is remembered per worker, keyed by the
+ * syspath of the device, and the walk up the chain stops at the first
+ * known ancestor. All disks behind the same controller or expander share
+ * these entries. The inode of the sysfs directory identifies the device
+ * instance; a removed and re-added device, and with it all its children,
+ * gets a new one.
+ */
+#define PATH_CACHE_MAX          1024
+#define PATH_WALK_MAX           64
+
+struct path_cache_entry {
+        char *syspath;
+        ino_t ino;
+        char *path;
+        bool supported_transport;
+        bool supported_parent;
+};
+
+static Hashmap *path_cache;
+
+static void path_cache_entry_free(struct path_cache_entry *e) {
+        if (!e)
+                return;
+
+        free(e->syspath);
+        free(e->path);
+        free(e);
+}
+
+static void path_cache_flush(void) {
+        struct path_cache_entry *e;
+
+        while ((e = hashmap_steal_first(path_cache)))
+                path_cache_entry_free(e);
+}
+
+static int device_get_ino(struct udev_device *dev, ino_t *ino) {
+        struct stat st;
+
+        if (stat(udev_device_get_syspath(dev), &st) < 0)
+                return -errno;
+
+        *ino = st.st_ino;
+        return 0;
+}
+
+static struct path_cache_entry *path_cache_get(struct udev_device *dev) {
+        struct path_cache_entry *e;
+        ino_t ino;
+
+        e = hashmap_get(path_cache, udev_device_get_syspath(dev));
+        if (!e)
+                return NULL;
+
+        if (device_get_ino(dev, &ino) < 0 || ino != e->ino) {
+                hashmap_remove(path_cache, e->syspath);
+                path_cache_entry_free(e);
+                return NULL;
+        }
+
+        return e;
+}
+
+static void path_cache_put(struct udev_device *dev, const char *path, size_t len,
+                           bool supported_transport, bool supported_parent) {
+        struct path_cache_entry *e;
+
+        if (hashmap_ensure_allocated(&path_cache, &string_hash_ops) < 0)
+                return;
+
+        if (hashmap_size(path_cache) >= PATH_CACHE_MAX)
+                path_cache_flush();
+
+        e = new0(struct path_cache_entry, 1);
+        if (!e)
+                return;
+
+        if (device_get_ino(dev, &e->ino) < 0)
+                goto fail;
+
+        e->syspath = strdup(udev_device_get_syspath(dev));
+        if (!e->syspath)
+                goto fail;
+
+        if (path && len > 0) {
+                e->path = strndup(path, len);
+                if (!e->path)
+                        goto fail;
+        }
+
+        e->supported_transport = supported_transport;
+        e->supported_parent = supported_parent;
+
+        if (hashmap_put(path_cache, e->syspath, e) < 0)
+                goto fail;
+
+        return;
+fail:
+        path_cache_entry_free(e);
+}
 
 _printf_(2,3)
 static int path_prepend(char **path, const char *fmt, ...) {
@@ -581,6 +686,15 @@ static int builtin_path_id(struct udev_device *dev, int argc, char *argv[], bool
         char *path = NULL;
         bool supported_transport = false;
         bool supported_parent = false;
+        struct {
+                struct udev_device *dev;
+                size_t len;
+                bool supported_transport;
+                bool supported_parent;
+        } walk[PATH_WALK_MAX];
+        unsigned int walk_len = 0;
+        bool cached_transport = false;
+        bool cached_parent = false;
 
         /* S390 ccw bus */
         parent = udev_device_get_parent_with_subsystem_devtype(dev, "ccw", NULL);
@@ -593,6 +707,28 @@ static int builtin_path_id(struct udev_device *dev, int argc, char *argv[], bool
         parent = dev;
         while (parent != NULL) {
                 const char *subsys;
+                bool transport = false;
+                bool supported = false;
+
+                if (parent != dev) {
+                        struct path_cache_entry *e;
+
+                        e = path_cache_get(parent);
+                        if (e) {
+                                if (e->path)
+                                        path_prepend(&path, "%s", e->path);
+                                cached_transport = e->supported_transport;
+                                cached_parent = e->supported_parent;
+                                supported_transport |= cached_transport;
+                                supported_parent |= cached_parent;
+                                break;
+                        }
+                }
+
+                if (walk_len < PATH_WALK_MAX) {
+                        walk[walk_len].dev = parent;
+                        walk[walk_len].len = path ? strlen(path) : 0;
+                }
 
                 subsys = udev_device_get_subsystem(parent);
                 if (subsys == NULL) {
@@ -600,47 +736,78 @@ static int builtin_path_id(struct udev_device *dev, int argc, char *argv[], bool
                 } else if (streq(subsys, "scsi_tape")) {
                         handle_scsi_tape(parent, &path);
                 } else if (streq(subsys, "scsi")) {
-                        parent = handle_scsi(parent, &path, &supported_parent);
-                        supported_transport = true;
+                        parent = handle_scsi(parent, &path, &supported);
+                        transport = true;
                 } else if (streq(subsys, "cciss")) {
                         parent = handle_cciss(parent, &path);
-                        supported_transport = true;
+                        transport = true;
                 } else if (streq(subsys, "usb")) {
                         parent = handle_usb(parent, &path);
-                        supported_transport = true;
+                        transport = true;
                 } else if (streq(subsys, "bcma")) {
                         parent = handle_bcma(parent, &path);
-                        supported_transport = true;
+                        transport = true;
                 } else if (streq(subsys, "serio")) {
                         path_prepend(&path, "serio-%s", udev_device_get_sysnum(parent));
                         parent = skip_subsystem(parent, "serio");
                 } else if (streq(subsys, "pci")) {
                         path_prepend(&path, "pci-%s", udev_device_get_sysname(parent));
                         parent = skip_subsystem(parent, "pci");
-                        supported_parent = true;
+                        supported = true;
                 } else if (streq(subsys, "platform")) {
                         path_prepend(&path, "platform-%s", udev_device_get_sysname(parent));
                         parent = skip_subsystem(parent, "platform");
-                        supported_transport = true;
-                        supported_parent = true;
+                        transport = true;
+                        supported = true;
                 } else if (streq(subsys, "acpi")) {
                         path_prepend(&path, "acpi-%s", udev_device_get_sysname(parent));
                         parent = skip_subsystem(parent, "acpi");
-                        supported_parent = true;
+                        supported = true;
                 } else if (streq(subsys, "xen")) {
                         path_prepend(&path, "xen-%s", udev_device_get_sysname(parent));
                         parent = skip_subsystem(parent, "xen");
-                        supported_parent = true;
+                        supported = true;
                 } else if (streq(subsys, "scm")) {
                         path_prepend(&path, "scm-%s", udev_device_get_sysname(parent));
                         parent = skip_subsystem(parent, "scm");
-                        supported_transport = true;
-                        supported_parent = true;
+                        transport = true;
+                        supported = true;
                 }
 
+                if (walk_len < PATH_WALK_MAX) {
+                        walk[walk_len].supported_transport = transport;
+                        walk[walk_len].supported_parent = supported;
+                        walk_len++;
+                }
+
+                supported_transport |= transport;
+                supported_parent |= supported;
+
                 parent = udev_device_get_parent(parent);
         }
 
+        /*
+         * Remember what every ancestor contributed. The leading part of the
+         * path was prepended by the ancestor itself and everything above it.
+         */
+        if (walk_len < PATH_WALK_MAX) {
+                size_t len = path ? strlen(path) : 0;
+                bool transport = cached_transport;
+                bool supported = cached_parent;
+                unsigned int i;
+
+                for (i = walk_len; i-- > 1; ) {
+                        transport |= walk[i].supported_transport;
+                        supported |= walk[i].supported_parent;
+
+                        if (walk[i].len >= len)
+                                path_cache_put(walk[i].dev, NULL, 0, transport, supported);
+                        else
+                                path_cache_put(walk[i].dev, path, len - walk[i].len - (walk[i].len > 0 ? 1 : 0),
+                                               transport, supported);
+                }
+        }
+
         /*
          * Do not return devices with an unknown parent device type. They
          * might produce conflicting IDs if the parent does not provide a
@@ -700,9 +867,16 @@ out:
         return EXIT_FAILURE;
 }
 
+/* called on udev shutdown and reload request */
+static void builtin_path_id_exit(struct udev *udev) {
+        path_cache_flush();
+        path_cache = hashmap_free(path_cache);
+}
+
 const struct udev_builtin udev_builtin_path_id = {
         .name = "path_id",
         .cmd = builtin_path_id,
+        .exit = builtin_path_id_exit,
         .help = "Compose persistent device path",
         .run_once = true,
 };
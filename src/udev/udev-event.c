@@ -884,6 +884,7 @@ void udev_event_execute_rules(struct udev_event *event,
         if (streq(udev_device_get_action(dev), "remove")) {
                 udev_device_read_db(dev);
                 udev_device_tag_index(dev, NULL, false);
+                udev_device_property_index(dev, NULL, false);
                 udev_device_delete_db(dev);
 
                 if (major(udev_device_get_devnum(dev)) != 0)
@@ -1041,6 +1042,7 @@ void udev_event_execute_rules(struct udev_event *event,
 
                 /* (re)write database file */
                 udev_device_tag_index(dev, event->dev_db, true);
+                udev_device_property_index(dev, event->dev_db, true);
                 udev_device_update_db(dev);
                 udev_device_set_is_initialized(dev);
 
@@ -125,6 +125,105 @@ exit:
         return err;
 }
 
+/*
+ * Every device claiming a link has an entry in the stack directory of the
+ * link, named by its device id. The entry is a symlink to
+ * "<priority>:<devnode>", so the stack is sorted out without reading the
+ * database of every claimant. Empty files written by older versions are
+ * still understood, by reading the database.
+ */
+/* the device node still belongs to the device with the id, "b8:0" or "c189:1" */
+static bool link_entry_claimant_exists(const char *id, const char *devnode) {
+        unsigned int maj, min;
+        struct stat st;
+        char type;
+
+        if (sscanf(id, "%c%u:%u", &type, &maj, &min) != 3 || (type != 'b' && type != 'c'))
+                return true;
+
+        if (stat(devnode, &st) < 0)
+                return false;
+        if (type == 'b' ? !S_ISBLK(st.st_mode) : !S_ISCHR(st.st_mode))
+                return false;
+        return st.st_rdev == makedev(maj, min);
+}
+
+static int link_entry_read(struct udev *udev, int dfd, const char *name, int *priority, char *devnode, size_t size) {
+        struct udev_device *dev_db;
+        char target[UTIL_PATH_SIZE];
+        ssize_t len;
+
+        len = readlinkat(dfd, name, target, sizeof(target));
+        if (len > 0 && len < (ssize_t) sizeof(target)) {
+                char *colon;
+
+                target[len] = '\0';
+                colon = strchr(target, ':');
+                if (colon == NULL || colon[1] != '/')
+                        return -EINVAL;
+                colon[0] = '\0';
+                if (safe_atoi(target, priority) < 0)
+                        return -EINVAL;
+                /* the entry of a device which is gone, without its remove event */
+                if (!link_entry_claimant_exists(name, &colon[1]))
+                        return -ENODEV;
+                strscpy(devnode, size, &colon[1]);
+                return 0;
+        }
+
+        dev_db = udev_device_new_from_device_id(udev, name);
+        if (dev_db == NULL)
+                return -ENODEV;
+        if (udev_device_get_devnode(dev_db) == NULL) {
+                udev_device_unref(dev_db);
+                return -ENODEV;
+        }
+        *priority = udev_device_get_devlink_priority(dev_db);
+        strscpy(devnode, size, udev_device_get_devnode(dev_db));
+        udev_device_unref(dev_db);
+        return 0;
+}
+
+static int link_entry_write(struct udev_device *dev, const char *dirname, const char *filename) {
+        char target[UTIL_PATH_SIZE];
+        char target_old[UTIL_PATH_SIZE];
+        char filename_tmp[UTIL_PATH_SIZE * 2];
+        ssize_t len;
+        int err;
+
+        snprintf(target, sizeof(target), "%i:%s",
+                 udev_device_get_devlink_priority(dev), udev_device_get_devnode(dev));
+
+        /* leave an unchanged entry alone */
+        len = readlink(filename, target_old, sizeof(target_old));
+        if (len > 0 && len < (ssize_t) sizeof(target_old)) {
+                target_old[len] = '\0';
+                if (streq(target, target_old))
+                        return 0;
+        }
+        /* hidden from readers of the stack, by the leading dot */
+        strscpyl(filename_tmp, sizeof(filename_tmp), dirname, "/.tmp-", udev_device_get_id_filename(dev), NULL);
+
+        unlink(filename_tmp);
+        do {
+                err = mkdir_parents(filename_tmp, 0755);
+                if (err != 0 && err != -ENOENT)
+                        break;
+                err = symlink(target, filename_tmp);
+                if (err != 0)
+                        err = -errno;
+        } while (err == -ENOENT);
+        if (err != 0)
+                return err;
+
+        if (rename(filename_tmp, filename) != 0) {
+                err = -errno;
+                unlink(filename_tmp);
+                return err;
+        }
+        return 0;
+}
+
 /* find device node of device with highest priority */
 static const char *link_find_prioritized(struct udev_device *dev, bool add, const char *stackdir, char *buf, size_t bufsize) {
         struct udev *udev = udev_device_get_udev(dev);
@@ -142,8 +241,9 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
         if (dir == NULL)
                 return target;
         for (;;) {
-                struct udev_device *dev_db;
                 struct dirent *dent;
+                char devnode[UTIL_PATH_SIZE];
+                int db_priority;
 
                 dent = readdir(dir);
                 if (dent == NULL || dent->d_name[0] == '\0')
@@ -157,21 +257,14 @@ static const char *link_find_prioritized(struct udev_device *dev, bool add, cons
                 if (streq(dent->d_name, udev_device_get_id_filename(dev)))
                         continue;
 
-                dev_db = udev_device_new_from_device_id(udev, dent->d_name);
-                if (dev_db != NULL) {
-                        const char *devnode;
-
-                        devnode = udev_device_get_devnode(dev_db);
-                        if (devnode != NULL) {
-                                if (target == NULL || udev_device_get_devlink_priority(dev_db) > priority) {
-                                        log_debug("'%s' claims priority %i for '%s'",
-                                                  udev_device_get_syspath(dev_db), udev_device_get_devlink_priority(dev_db), stackdir);
-                                        priority = udev_device_get_devlink_priority(dev_db);
-                                        strscpy(buf, bufsize, devnode);
-                                        target = buf;
-                                }
-                        }
-                        udev_device_unref(dev_db);
+                if (link_entry_read(udev, dirfd(dir), dent->d_name, &db_priority, devnode, sizeof(devnode)) < 0)
+                        continue;
+
+                if (target == NULL || db_priority > priority) {
+                        log_debug("'%s' claims priority %i for '%s'", dent->d_name, db_priority, stackdir);
+                        priority = db_priority;
+                        strscpy(buf, bufsize, devnode);
+                        target = buf;
                 }
         }
         closedir(dir);
@@ -190,8 +283,16 @@ static void link_update(struct udev_device *dev, const char *slink, bool add) {
         strscpyl(dirname, sizeof(dirname), UDEV_ROOT_RUN "/udev/links/", name_enc, NULL);
         strscpyl(filename, sizeof(filename), dirname, "/", udev_device_get_id_filename(dev), NULL);
 
-        if (!add && unlink(filename) == 0)
-                rmdir(dirname);
+        if (!add) {
+                char filename_tmp[UTIL_PATH_SIZE * 2];
+
+                /* a possible left-over of an interrupted link_entry_write() */
+                strscpyl(filename_tmp, sizeof(filename_tmp), dirname, "/.tmp-", udev_device_get_id_filename(dev), NULL);
+                unlink(filename_tmp);
+
+                if (unlink(filename) == 0)
+                        rmdir(dirname);
+        }
 
         target = link_find_prioritized(dev, add, dirname, buf, sizeof(buf));
         if (target == NULL) {
@@ -206,18 +307,9 @@ static void link_update(struct udev_device *dev, const char *slink, bool add) {
         if (add) {
                 int err;
 
-                do {
-                        int fd;
-
-                        err = mkdir_parents(filename, 0755);
-                        if (err != 0 && err != -ENOENT)
-                                break;
-                        fd = open(filename, O_WRONLY|O_CREAT|O_CLOEXEC|O_TRUNC|O_NOFOLLOW, 0444);
-                        if (fd >= 0)
-                                close(fd);
-                        else
-                                err = -errno;
-                } while (err == -ENOENT);
+                err = link_entry_write(dev, dirname, filename);
+                if (err < 0)
+                        log_debug_errno(err, "failed to write '%s': %m", filename);
         }
 }
 
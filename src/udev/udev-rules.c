@@ -37,6 +37,7 @@
 #include "strv.h"
 #include "util.h"
 #include "sysctl-util.h"
+#include "hashmap.h"
 
 #define PREALLOC_TOKEN          2048
 
@@ -79,6 +80,9 @@ struct udev_rules {
         struct uid_gid *gids;
         unsigned int gids_cur;
         unsigned int gids_max;
+
+        /* sysfs attributes referenced by the rules of a subsystem, read in one go per event */
+        Hashmap *sysattrs;
 };
 
 static char *rules_str(struct udev_rules *rules, unsigned int off) {
@@ -686,6 +690,19 @@ static int import_parent_into_properties(struct udev_device *dev, const char *fi
 }
 
 #define WAIT_LOOP_PER_SECOND                50
+/* drop the cached value of the attribute of the device at @file, a syspath relative or absolute path */
+static void attr_forget(struct udev_device *dev, const char *file) {
+        const char *syspath = udev_device_get_syspath(dev);
+
+        if (file[0] == '/') {
+                file = startswith(file, syspath);
+                if (file == NULL || file[0] != '/')
+                        return;
+                file++;
+        }
+        udev_device_forget_sysattr(dev, file);
+}
+
 static int wait_for_file(struct udev_device *dev, const char *file, int timeout) {
         char filepath[UTIL_PATH_SIZE];
         char devicepath[UTIL_PATH_SIZE];
@@ -1679,6 +1696,180 @@ static int parse_file(struct udev_rules *rules, const char *filename) {
         return 0;
 }
 
+static int sysattrs_add(struct udev_rules *rules, const char *subsystem, const char *sysattr, size_t len) {
+        _cleanup_free_ char *name = NULL;
+        char *key;
+        char **l, **s;
+        int r;
+
+        if (len == 0 || len >= UTIL_NAME_SIZE)
+                return 0;
+
+        name = strndup(sysattr, len);
+        if (!name)
+                return -ENOMEM;
+
+        /* skip everything we cannot know before the event is handled */
+        if (string_is_glob(name) || strpbrk(name, "$%") || name[0] == '[' || name[0] == '/')
+                return 0;
+
+        l = hashmap_get(rules->sysattrs, subsystem);
+        STRV_FOREACH(s, l)
+                if (streq(*s, name))
+                        return 0;
+
+        r = strv_consume(&l, name);
+        name = NULL;
+        if (r < 0)
+                return r;
+
+        if (hashmap_contains(rules->sysattrs, subsystem))
+                return hashmap_update(rules->sysattrs, subsystem, l);
+
+        key = strdup(subsystem);
+        if (!key) {
+                strv_free(l);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(rules->sysattrs, key, l);
+        if (r < 0) {
+                free(key);
+                strv_free(l);
+                return r;
+        }
+
+        return 0;
+}
+
+/* add the names of "$attr{...}" and "%s{...}" substitutions */
+static int sysattrs_add_format(struct udev_rules *rules, const char *subsystem, const char *format) {
+        const char *s = format;
+
+        while ((s = strpbrk(s, "$%")) != NULL) {
+                const char *end;
+
+                if (startswith(s, "$attr{"))
+                        s += strlen("$attr{");
+                else if (startswith(s, "$sysfs{"))
+                        s += strlen("$sysfs{");
+                else if (startswith(s, "%s{"))
+                        s += strlen("%s{");
+                else {
+                        s++;
+                        continue;
+                }
+
+                end = strchr(s, '}');
+                if (!end)
+                        break;
+
+                if (sysattrs_add(rules, subsystem, s, end - s) < 0)
+                        return -ENOMEM;
+                s = end;
+        }
+
+        return 0;
+}
+
+/*
+ * Collect the attributes of the device itself that ATTR keys and format
+ * strings refer to, for every rule which is limited to one or more
+ * subsystems by a plain SUBSYSTEM match.
+ */
+/*
+ * Only attributes which the rules would read anyway are read ahead: the
+ * first ATTR match of a rule which matches on nothing but the subsystem
+ * before it, and the substituted attributes of a rule which matches on
+ * nothing but the subsystem. Rules which a GOTO might skip are left out,
+ * unless the GOTO depends only on a remove event or on the subsystem not
+ * being a certain one.
+ */
+static int rules_collect_sysattrs(struct udev_rules *rules) {
+        unsigned int skip_until = 0;
+        unsigned int i = 0;
+        int r;
+
+        rules->sysattrs = hashmap_new(&string_hash_ops);
+        if (!rules->sysattrs)
+                return -ENOMEM;
+
+        while (i < rules->token_cur) {
+                struct token *rule = &rules->tokens[i];
+                struct token *subsystem = NULL;
+                struct token *attr = NULL;
+                bool subsystem_only = true;
+                bool goto_skips = false;
+                char subsystems[UTIL_NAME_SIZE];
+                unsigned int j, count;
+                char *ss, *state;
+
+                if (rule->type != TK_RULE) {
+                        i++;
+                        continue;
+                }
+                count = rule->rule.token_count;
+
+                for (j = i + 1; j < i + count; j++) {
+                        struct token *t = &rules->tokens[j];
+
+                        if (t->type == TK_M_SUBSYSTEM && t->key.op == OP_MATCH && subsystem == NULL &&
+                            (t->key.glob == GL_PLAIN || t->key.glob == GL_SPLIT))
+                                subsystem = t;
+                        else if (t->type < TK_M_MAX) {
+                                if (t->type == TK_M_ATTR && subsystem_only && attr == NULL)
+                                        attr = t;
+                                subsystem_only = false;
+
+                                if (t->type == TK_M_SUBSYSTEM && t->key.op == OP_NOMATCH)
+                                        continue;
+                                if (t->type == TK_M_ACTION && t->key.op == OP_MATCH &&
+                                    streq(rules_str(rules, t->key.value_off), "remove"))
+                                        continue;
+                                goto_skips = true;
+                        }
+                }
+
+                /* the rules up to the label are not run if the GOTO rule matches */
+                for (j = i + 1; j < i + count; j++) {
+                        struct token *t = &rules->tokens[j];
+
+                        if (t->type == TK_A_GOTO && goto_skips && t->key.rule_goto > skip_until)
+                                skip_until = t->key.rule_goto;
+                }
+
+                if (subsystem && i >= skip_until) {
+                        strscpy(subsystems, sizeof(subsystems), rules_str(rules, subsystem->key.value_off));
+                        for (ss = strtok_r(subsystems, "|", &state); ss; ss = strtok_r(NULL, "|", &state)) {
+                                if (attr && attr->key.attrsubst == SB_NONE) {
+                                        const char *name = rules_str(rules, attr->key.attr_off);
+
+                                        r = sysattrs_add(rules, ss, name, strlen(name));
+                                        if (r < 0)
+                                                return r;
+                                }
+
+                                if (!subsystem_only)
+                                        continue;
+
+                                for (j = i + 1; j < i + count; j++) {
+                                        struct token *t = &rules->tokens[j];
+
+                                        if (t->type != TK_A_GOTO && t->key.subst == SB_FORMAT) {
+                                                r = sysattrs_add_format(rules, ss, rules_str(rules, t->key.value_off));
+                                                if (r < 0)
+                                                        return r;
+                                        }
+                                }
+                        }
+                }
+
+                i += count;
+        }
+
+        return 0;
+}
+
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         struct udev_rules *rules;
         struct udev_list file_list;
@@ -1726,6 +1917,10 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         memzero(&end_token, sizeof(struct token));
         end_token.type = TK_END;
         add_token(rules, &end_token);
+
+        if (rules_collect_sysattrs(rules) < 0)
+                log_debug("failed to collect sysfs attributes used by the rules, not reading them ahead");
+
         log_debug("rules contain %zu bytes tokens (%u * %zu bytes), %zu bytes strings",
                   rules->token_max * sizeof(struct token), rules->token_max, sizeof(struct token), rules->strbuf->len);
 
@@ -1752,6 +1947,17 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
 struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
         if (rules == NULL)
                 return NULL;
+        if (rules->sysattrs) {
+                char **l;
+                char *key;
+                Iterator i;
+
+                HASHMAP_FOREACH(l, rules->sysattrs, i)
+                        strv_free(l);
+                while ((key = hashmap_steal_first_key(rules->sysattrs)))
+                        free(key);
+                hashmap_free(rules->sysattrs);
+        }
         free(rules->tokens);
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
@@ -1912,6 +2118,14 @@ int udev_rules_apply_to_event(struct udev_rules *rules,
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
 
+        /* read the attributes the rules of this subsystem will ask for */
+        if (rules->sysattrs && !streq(udev_device_get_action(event->dev), "remove")) {
+                const char *subsystem = udev_device_get_subsystem(event->dev);
+
+                if (subsystem)
+                        udev_device_read_sysattrs(event->dev, hashmap_get(rules->sysattrs, subsystem));
+        }
+
         /* loop through token list, match, run actions or forward to next rule */
         cur = &rules->tokens[0];
         rule = cur;
@@ -1969,8 +2183,7 @@ int udev_rules_apply_to_event(struct udev_rules *rules,
                         if (!value && properties_list) {
                                 struct udev_list_entry *list_entry;
 
-                                list_entry = udev_list_get_entry(properties_list);
-                                list_entry = udev_list_entry_get_by_name(list_entry, key_name);
+                                list_entry = udev_list_get_entry_by_name(properties_list, key_name);
                                 if (list_entry != NULL)
                                         value = udev_list_entry_get_value(list_entry);
                         }
@@ -2009,6 +2222,7 @@ int udev_rules_apply_to_event(struct udev_rules *rules,
 
                         udev_event_apply_format(event, rules_str(rules, cur->key.value_off), filename, sizeof(filename), false);
                         found = (wait_for_file(event->dev, filename, 10) == 0);
+                        attr_forget(event->dev, filename);
                         if (!found && (cur->key.op != OP_NOMATCH))
                                 goto nomatch;
                         break;
@@ -2568,6 +2782,7 @@ int udev_rules_apply_to_event(struct udev_rules *rules,
                         } else {
                                 log_error_errno(errno, "error opening ATTR{%s} for writing: %m", attr);
                         }
+                        attr_forget(event->dev, attr);
                         break;
                 }
                 case TK_A_SYSCTL: {
@@ -22,10 +22,14 @@
 #include <getopt.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "util.h"
 #include "strbuf.h"
 #include "conf-files.h"
+#include "mempool.h"
+#include "siphash24.h"
 
 #include "udev.h"
 #include "libudev-hwdb-def.h"
@@ -49,6 +53,7 @@ struct trie {
         size_t nodes_count;
         size_t children_count;
         size_t values_count;
+        size_t globs_count;
 };
 
 struct trie_node {
@@ -58,10 +63,19 @@ struct trie_node {
         /* sorted array of pointers to children nodes */
         struct trie_child_entry *children;
         uint8_t children_count;
+        size_t children_allocated;
 
         /* sorted array of key/value pairs */
         struct trie_value_entry *values;
         size_t values_count;
+        size_t values_allocated;
+
+        /* matches with a wildcard, which the search evaluates at this node */
+        struct trie_glob_entry *globs;
+        size_t globs_count;
+
+        /* offset in the written file */
+        uint64_t off;
 };
 
 /* children array item with char (0-255) index */
@@ -76,6 +90,20 @@ struct trie_value_entry {
         size_t value_off;
 };
 
+/* glob index item, the match pattern starting at its first wildcard */
+struct trie_glob_entry {
+        size_t pattern_off;
+        struct trie_node *node;
+        uint8_t flags;
+};
+
+/* all nodes are allocated from one pool, and released at once */
+static DEFINE_MEMPOOL(trie_node_pool, struct trie_node, 1024);
+
+static struct trie_node *trie_node_new(void) {
+        return mempool_alloc0_tile(&trie_node_pool);
+}
+
 static int trie_children_cmp(const void *v1, const void *v2) {
         const struct trie_child_entry *n1 = v1;
         const struct trie_child_entry *n2 = v2;
@@ -84,19 +112,26 @@ static int trie_children_cmp(const void *v1, const void *v2) {
 }
 
 static int node_add_child(struct trie *trie, struct trie_node *node, struct trie_node *node_child, uint8_t c) {
-        struct trie_child_entry *child;
+        size_t left = 0, right = node->children_count;
 
-        /* extend array, add new entry, sort for bisection */
-        child = realloc(node->children, (node->children_count + 1) * sizeof(struct trie_child_entry));
-        if (!child)
+        if (!GREEDY_REALLOC(node->children, node->children_allocated, node->children_count + 1))
                 return -ENOMEM;
 
-        node->children = child;
-        trie->children_count++;
-        node->children[node->children_count].c = c;
-        node->children[node->children_count].child = node_child;
+        /* insert new entry at its sorted position for bisection */
+        while (right > left) {
+                size_t middle = (left + right) / 2;
+
+                if (node->children[middle].c < c)
+                        left = middle + 1;
+                else
+                        right = middle;
+        }
+        memmove(node->children + left + 1, node->children + left,
+                (node->children_count - left) * sizeof(struct trie_child_entry));
+        node->children[left].c = c;
+        node->children[left].child = node_child;
         node->children_count++;
-        qsort(node->children, node->children_count, sizeof(struct trie_child_entry), trie_children_cmp);
+        trie->children_count++;
         trie->nodes_count++;
 
         return 0;
@@ -113,6 +148,7 @@ static struct trie_node *node_lookup(const struct trie_node *node, uint8_t c) {
         return NULL;
 }
 
+/* the nodes themselves are released with the pool */
 static void trie_node_cleanup(struct trie_node *node) {
         size_t i;
 
@@ -120,28 +156,13 @@ static void trie_node_cleanup(struct trie_node *node) {
                 trie_node_cleanup(node->children[i].child);
         free(node->children);
         free(node->values);
-        free(node);
-}
-
-
-static __thread void* trie_values_cmp_param;
-static int trie_values_cmp(const void *v1, const void *v2) {
-        const struct trie_value_entry *val1 = v1;
-        const struct trie_value_entry *val2 = v2;
-        struct trie *trie = trie_values_cmp_param;
-
-        return strcmp(trie->strings->buf + val1->key_off,
-                      trie->strings->buf + val2->key_off);
-}
-static int trie_values_cmp_r(const void *v1, const void *v2, void* arg) {
-	trie_values_cmp_param = arg;
-	return trie_values_cmp(v1, v2);
+        free(node->globs);
 }
 
 static int trie_node_add_value(struct trie *trie, struct trie_node *node,
                           const char *key, const char *value) {
+        size_t left = 0, right = node->values_count;
         ssize_t k, v;
-        struct trie_value_entry *val;
 
         k = strbuf_add_string(trie->strings, key, strlen(key));
         if (k < 0)
@@ -150,31 +171,31 @@ static int trie_node_add_value(struct trie *trie, struct trie_node *node,
         if (v < 0)
                 return v;
 
-        if (node->values_count) {
-                struct trie_value_entry search = {
-                        .key_off = k,
-                        .value_off = v,
-                };
+        while (right > left) {
+                size_t middle = (left + right) / 2;
+                int cmp;
 
-                val = xbsearch_r(&search, node->values, node->values_count, sizeof(struct trie_value_entry), trie_values_cmp_r, trie);
-                if (val) {
+                cmp = strcmp(trie->strings->buf + node->values[middle].key_off, key);
+                if (cmp == 0) {
                         /* replace existing earlier key with new value */
-                        val->value_off = v;
+                        node->values[middle].value_off = v;
                         return 0;
                 }
+                if (cmp < 0)
+                        left = middle + 1;
+                else
+                        right = middle;
         }
 
-        /* extend array, add new entry, sort for bisection */
-        val = realloc(node->values, (node->values_count + 1) * sizeof(struct trie_value_entry));
-        if (!val)
+        /* insert new entry at its sorted position for bisection */
+        if (!GREEDY_REALLOC(node->values, node->values_allocated, node->values_count + 1))
                 return -ENOMEM;
-        trie->values_count++;
-        node->values = val;
-        node->values[node->values_count].key_off = k;
-        node->values[node->values_count].value_off = v;
+        memmove(node->values + left + 1, node->values + left,
+                (node->values_count - left) * sizeof(struct trie_value_entry));
+        node->values[left].key_off = k;
+        node->values[left].value_off = v;
         node->values_count++;
-	trie_values_cmp_param = trie;
-        qsort(node->values, node->values_count, sizeof(struct trie_value_entry), trie_values_cmp);
+        trie->values_count++;
         return 0;
 }
 
@@ -191,23 +212,11 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
                 for (p = 0; (c = trie->strings->buf[node->prefix_off + p]); p++) {
                         _cleanup_free_ char *s = NULL;
                         ssize_t off;
-                        _cleanup_free_ struct trie_node *new_child = NULL;
+                        struct trie_node *new_child;
 
                         if (c == search[i + p])
                                 continue;
 
-                        /* split node */
-                        new_child = new0(struct trie_node, 1);
-                        if (!new_child)
-                                return -ENOMEM;
-
-                        /* move values from parent to child */
-                        new_child->prefix_off = node->prefix_off + p+1;
-                        new_child->children = node->children;
-                        new_child->children_count = node->children_count;
-                        new_child->values = node->values;
-                        new_child->values_count = node->values_count;
-
                         /* update parent; use strdup() because the source gets realloc()d */
                         s = strndup(trie->strings->buf + node->prefix_off, p);
                         if (!s)
@@ -217,16 +226,29 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
                         if (off < 0)
                                 return off;
 
+                        /* split node */
+                        new_child = trie_node_new();
+                        if (!new_child)
+                                return -ENOMEM;
+
+                        /* move values from parent to child */
+                        *new_child = *node;
+                        new_child->prefix_off = node->prefix_off + p+1;
+
                         node->prefix_off = off;
                         node->children = NULL;
                         node->children_count = 0;
+                        node->children_allocated = 0;
                         node->values = NULL;
                         node->values_count = 0;
+                        node->values_allocated = 0;
                         err = node_add_child(trie, node, new_child, c);
-                        if (err)
+                        if (err) {
+                                /* undo the split */
+                                *node = *new_child;
+                                mempool_free_tile(&trie_node_pool, new_child);
                                 return err;
-
-                        new_child = NULL; /* avoid cleanup */
+                        }
                         break;
                 }
                 i += p;
@@ -240,20 +262,20 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
                         ssize_t off;
 
                         /* new child */
-                        child = new0(struct trie_node, 1);
+                        child = trie_node_new();
                         if (!child)
                                 return -ENOMEM;
 
                         off = strbuf_add_string(trie->strings, search + i+1, strlen(search + i+1));
                         if (off < 0) {
-                                free(child);
+                                mempool_free_tile(&trie_node_pool, child);
                                 return off;
                         }
 
                         child->prefix_off = off;
                         err = node_add_child(trie, node, child, c);
                         if (err) {
-                                free(child);
+                                mempool_free_tile(&trie_node_pool, child);
                                 return err;
                         }
 
@@ -265,16 +287,150 @@ static int trie_insert(struct trie *trie, struct trie_node *node, const char *se
         }
 }
 
+/* a single match is found as fast by walking the trie, as by the glob index */
+#define GLOB_GROUP_MIN 2
+
+static bool is_glob_char(char c) {
+        return c == '*' || c == '?' || c == '[';
+}
+
+static size_t trie_node_count_matches(const struct trie_node *node) {
+        size_t n = node->values_count > 0;
+        size_t i;
+
+        for (i = 0; i < node->children_count; i++)
+                n += trie_node_count_matches(node->children[i].child);
+        return n;
+}
+
+static int node_add_glob(struct trie *trie, struct trie_node *owner, struct trie_node *node,
+                         const char *pattern) {
+        struct trie_glob_entry *glob;
+        ssize_t off;
+
+        off = strbuf_add_string(trie->strings, pattern, strlen(pattern));
+        if (off < 0)
+                return off;
+
+        glob = realloc(owner->globs, (owner->globs_count + 1) * sizeof(struct trie_glob_entry));
+        if (!glob)
+                return -ENOMEM;
+        owner->globs = glob;
+        owner->globs[owner->globs_count].pattern_off = off;
+        owner->globs[owner->globs_count].node = node;
+        owner->globs[owner->globs_count].flags = pattern[strcspn(pattern, "?[\\")] == '\0' ? TRIE_GLOB_F2_STAR : 0;
+        owner->globs_count++;
+        trie->globs_count++;
+        return 0;
+}
+
+/*
+ * Collect the matches with a wildcard at the node where the search reaches
+ * their first wildcard. The post-order walk keeps the order in which the
+ * search would find them in the trie. Nodes with fewer than GLOB_GROUP_MIN
+ * matches get no group, the search walks the trie below them.
+ */
+static int trie_collect_globs(struct trie *trie, struct trie_node *node, struct trie_node *owner,
+                              char *pattern, size_t len) {
+        const char *prefix = trie->strings->buf + node->prefix_off;
+        size_t plen = strlen(prefix);
+        bool index_children = false;
+        size_t i;
+        int err;
+
+        if (!owner) {
+                size_t p = strcspn(prefix, "*?[");
+
+                if (prefix[p] != '\0') {
+                        if (trie_node_count_matches(node) < GLOB_GROUP_MIN)
+                                return 0;
+                        owner = node;
+                        prefix += p;
+                        plen -= p;
+                } else {
+                        size_t n = 0;
+
+                        for (i = 0; i < node->children_count; i++)
+                                if (is_glob_char(node->children[i].c))
+                                        n += trie_node_count_matches(node->children[i].child);
+                        index_children = n >= GLOB_GROUP_MIN;
+                }
+        }
+        if (owner) {
+                if (len + plen + 1 >= LINE_MAX)
+                        return -ENAMETOOLONG;
+                memcpy(pattern + len, prefix, plen);
+                len += plen;
+        }
+
+        for (i = 0; i < node->children_count; i++) {
+                struct trie_node *child_owner = owner;
+                size_t child_len = len;
+
+                if (!owner && is_glob_char(node->children[i].c)) {
+                        if (!index_children)
+                                continue;
+                        child_owner = node;
+                }
+                if (child_owner)
+                        pattern[child_len++] = node->children[i].c;
+
+                err = trie_collect_globs(trie, node->children[i].child, child_owner, pattern, child_len);
+                if (err < 0)
+                        return err;
+        }
+
+        if (owner && node->values_count) {
+                pattern[len] = '\0';
+                err = node_add_glob(trie, owner, node, pattern);
+                if (err < 0)
+                        return err;
+        }
+
+        return 0;
+}
+
 struct trie_f {
         FILE *f;
         struct trie *trie;
+        unsigned int version;
         uint64_t strings_off;
 
+        /* nodes with glob index entries, in file order */
+        struct trie_node **glob_nodes;
+        size_t glob_nodes_count;
+
         uint64_t nodes_count;
         uint64_t children_count;
         uint64_t values_count;
 };
 
+/* number of slots of a direct-index children table, 0 if the sorted array is smaller */
+static unsigned int node_direct_slots(const struct trie_node *node) {
+        unsigned int slots;
+
+        if (node->children_count < 16)
+                return 0;
+
+        slots = node->children[node->children_count - 1].c - node->children[0].c + 1;
+        if (slots * sizeof(le32_t) > 2 * node->children_count * (sizeof(uint8_t) + sizeof(le32_t)))
+                return 0;
+        return slots;
+}
+
+static uint64_t node_size_f2(const struct trie_node *node) {
+        uint64_t size = sizeof(struct trie_node_f2);
+        unsigned int slots;
+
+        slots = node_direct_slots(node);
+        if (slots > 0)
+                size += 2 * sizeof(uint8_t) + slots * sizeof(le32_t);
+        else
+                size += node->children_count * (sizeof(uint8_t) + sizeof(le32_t));
+        size += node->values_count * sizeof(struct trie_value_entry_f2);
+        return size;
+}
+
 /* calculate the storage space for the nodes, children arrays, value arrays */
 static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
         uint64_t i;
@@ -282,6 +438,11 @@ static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
         for (i = 0; i < node->children_count; i++)
                 trie_store_nodes_size(trie, node->children[i].child);
 
+        if (trie->version >= 2) {
+                trie->strings_off += node_size_f2(node);
+                return;
+        }
+
         trie->strings_off += sizeof(struct trie_node_f);
         for (i = 0; i < node->children_count; i++)
                 trie->strings_off += sizeof(struct trie_child_entry_f);
@@ -289,6 +450,88 @@ static void trie_store_nodes_size(struct trie_f *trie, struct trie_node *node) {
                 trie->strings_off += sizeof(struct trie_value_entry_f);
 }
 
+static int64_t trie_store_nodes_f2(struct trie_f *trie, struct trie_node *node) {
+        _cleanup_free_ le32_t *child_offs = NULL;
+        struct trie_node_f2 n = {
+                .prefix_off = htole32(trie->strings_off + node->prefix_off),
+                .values_count = htole32(node->values_count),
+                .children_count = node->children_count,
+        };
+        unsigned int slots;
+        int64_t node_off;
+        uint64_t i;
+
+        slots = node_direct_slots(node);
+        if (slots > 0)
+                n.flags |= TRIE_NODE_F2_DIRECT;
+
+        if (node->children_count) {
+                child_offs = new0(le32_t, slots > 0 ? slots : node->children_count);
+                if (!child_offs)
+                        return -ENOMEM;
+        }
+
+        /* post-order recursion */
+        for (i = 0; i < node->children_count; i++) {
+                int64_t child_off;
+
+                child_off = trie_store_nodes_f2(trie, node->children[i].child);
+                if (child_off < 0)
+                        return child_off;
+                if (slots > 0)
+                        child_offs[node->children[i].c - node->children[0].c] = htole32(child_off);
+                else
+                        child_offs[i] = htole32(child_off);
+        }
+
+        /* write node */
+        node_off = ftello(trie->f);
+        if (node_off > UINT32_MAX)
+                return -EFBIG;
+        fwrite(&n, sizeof(struct trie_node_f2), 1, trie->f);
+        trie->nodes_count++;
+        node->off = node_off;
+
+        if (node->globs_count) {
+                struct trie_node **nodes;
+
+                nodes = realloc(trie->glob_nodes, (trie->glob_nodes_count + 1) * sizeof(struct trie_node *));
+                if (!nodes)
+                        return -ENOMEM;
+                trie->glob_nodes = nodes;
+                trie->glob_nodes[trie->glob_nodes_count++] = node;
+        }
+
+        /* append children */
+        if (slots > 0) {
+                uint8_t range[2] = { node->children[0].c, slots };
+
+                fwrite(range, sizeof(range), 1, trie->f);
+                fwrite(child_offs, sizeof(le32_t), slots, trie->f);
+        } else if (node->children_count) {
+                uint8_t keys[node->children_count];
+
+                for (i = 0; i < node->children_count; i++)
+                        keys[i] = node->children[i].c;
+                fwrite(keys, sizeof(uint8_t), node->children_count, trie->f);
+                fwrite(child_offs, sizeof(le32_t), node->children_count, trie->f);
+        }
+        trie->children_count += node->children_count;
+
+        /* append values array */
+        for (i = 0; i < node->values_count; i++) {
+                struct trie_value_entry_f2 v = {
+                        .key_off = htole32(trie->strings_off + node->values[i].key_off),
+                        .value_off = htole32(trie->strings_off + node->values[i].value_off),
+                };
+
+                fwrite(&v, sizeof(struct trie_value_entry_f2), 1, trie->f);
+                trie->values_count++;
+        }
+
+        return node_off;
+}
+
 static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         uint64_t i;
         struct trie_node_f n = {
@@ -344,9 +587,44 @@ static int64_t trie_store_nodes(struct trie_f *trie, struct trie_node *node) {
         return node_off;
 }
 
-static int trie_store(struct trie *trie, const char *filename) {
+/* write the glob index, the groups are sorted by node offset from the post-order walk */
+static void trie_store_globs_f2(struct trie_f *trie) {
+        uint64_t entries_off;
+        size_t i, j;
+
+        entries_off = ftello(trie->f) + trie->glob_nodes_count * sizeof(struct trie_glob_group_f2);
+        for (i = 0; i < trie->glob_nodes_count; i++) {
+                struct trie_node *node = trie->glob_nodes[i];
+                struct trie_glob_group_f2 g = {
+                        .node_off = htole32(node->off),
+                        .entries_off = htole32(entries_off),
+                        .entries_count = htole32(node->globs_count),
+                };
+
+                fwrite(&g, sizeof(struct trie_glob_group_f2), 1, trie->f);
+                entries_off += node->globs_count * sizeof(struct trie_glob_entry_f2);
+        }
+
+        for (i = 0; i < trie->glob_nodes_count; i++) {
+                struct trie_node *node = trie->glob_nodes[i];
+
+                for (j = 0; j < node->globs_count; j++) {
+                        struct trie_glob_entry_f2 e = {
+                                .pattern_off = htole32(trie->strings_off + node->globs[j].pattern_off),
+                                .node_off = htole32(node->globs[j].node->off),
+                                .flags = node->globs[j].flags,
+                        };
+
+                        fwrite(&e, sizeof(struct trie_glob_entry_f2), 1, trie->f);
+                }
+        }
+}
+
+static int trie_store(struct trie *trie, const char *filename, unsigned int version,
+                      const uint8_t sources_hash[8]) {
         struct trie_f t = {
                 .trie = trie,
+                .version = version,
         };
         _cleanup_free_ char *filename_tmp = NULL;
         int64_t pos;
@@ -360,11 +638,27 @@ static int trie_store(struct trie *trie, const char *filename) {
                 .child_entry_size = htole64(sizeof(struct trie_child_entry_f)),
                 .value_entry_size = htole64(sizeof(struct trie_value_entry_f)),
         };
+        struct trie_header_f2 h2 = {
+                .signature = HWDB_SIG_V2,
+                .tool_version = htole64(atoi(VERSION)),
+                .header_size = htole32(sizeof(struct trie_header_f2)),
+                .node_size = htole32(sizeof(struct trie_node_f2)),
+                .value_entry_size = htole32(sizeof(struct trie_value_entry_f2)),
+                .glob_group_size = htole32(sizeof(struct trie_glob_group_f2)),
+                .glob_entry_size = htole32(sizeof(struct trie_glob_entry_f2)),
+        };
+        size_t header_size = version >= 2 ? sizeof(struct trie_header_f2) : sizeof(struct trie_header_f);
         int err;
 
+        memcpy(h.sources_hash, sources_hash, sizeof(h.sources_hash));
+        memcpy(h2.sources_hash, sources_hash, sizeof(h2.sources_hash));
+
         /* calculate size of header, nodes, children entries, value entries */
-        t.strings_off = sizeof(struct trie_header_f);
+        t.strings_off = header_size;
         trie_store_nodes_size(&t, trie->root);
+        if (version >= 2 && t.strings_off + trie->strings->len +
+                            trie->globs_count * (sizeof(struct trie_glob_group_f2) + sizeof(struct trie_glob_entry_f2)) > UINT32_MAX)
+                return -EFBIG;
 
         err = fopen_temporary(filename , &t.f, &filename_tmp);
         if (err < 0)
@@ -372,31 +666,55 @@ static int trie_store(struct trie *trie, const char *filename) {
         fchmod(fileno(t.f), 0444);
 
         /* write nodes */
-        err = fseeko(t.f, sizeof(struct trie_header_f), SEEK_SET);
+        err = fseeko(t.f, header_size, SEEK_SET);
         if (err < 0) {
                 fclose(t.f);
                 unlink_noerrno(filename_tmp);
                 return -errno;
         }
-        root_off = trie_store_nodes(&t, trie->root);
-        h.nodes_root_off = htole64(root_off);
+        if (version >= 2)
+                root_off = trie_store_nodes_f2(&t, trie->root);
+        else
+                root_off = trie_store_nodes(&t, trie->root);
+        if (root_off < 0) {
+                fclose(t.f);
+                unlink_noerrno(filename_tmp);
+                free(t.glob_nodes);
+                return root_off;
+        }
         pos = ftello(t.f);
-        h.nodes_len = htole64(pos - sizeof(struct trie_header_f));
+        h.nodes_root_off = htole64(root_off);
+        h.nodes_len = htole64(pos - header_size);
+        h2.nodes_root_off = htole32(root_off);
+        h2.nodes_len = htole32(pos - header_size);
 
         /* write string buffer */
         fwrite(trie->strings->buf, trie->strings->len, 1, t.f);
         h.strings_len = htole64(trie->strings->len);
+        h2.strings_len = htole32(trie->strings->len);
+
+        /* write glob index */
+        if (version >= 2) {
+                h2.globs_off = htole32(ftello(t.f));
+                h2.globs_count = htole32(t.glob_nodes_count);
+                trie_store_globs_f2(&t);
+                free(t.glob_nodes);
+        }
 
         /* write header */
         size = ftello(t.f);
         h.file_size = htole64(size);
+        h2.file_size = htole64(size);
         err = fseeko(t.f, 0, SEEK_SET);
         if (err < 0) {
                 fclose(t.f);
                 unlink_noerrno(filename_tmp);
                 return -errno;
         }
-        fwrite(&h, sizeof(struct trie_header_f), 1, t.f);
+        if (version >= 2)
+                fwrite(&h2, sizeof(struct trie_header_f2), 1, t.f);
+        else
+                fwrite(&h, sizeof(struct trie_header_f), 1, t.f);
         err = ferror(t.f);
         if (err)
                 err = -errno;
@@ -406,25 +724,59 @@ static int trie_store(struct trie *trie, const char *filename) {
                 return err < 0 ? err : -errno;
         }
 
-        log_debug("=== trie on-disk ===");
+        log_debug("=== trie on-disk (version %u) ===", version);
         log_debug("size:             %8"PRIi64" bytes", size);
-        log_debug("header:           %8zu bytes", sizeof(struct trie_header_f));
+        log_debug("header:           %8zu bytes", header_size);
         log_debug("nodes:            %8"PRIu64" bytes (%8"PRIu64")",
-                  t.nodes_count * sizeof(struct trie_node_f), t.nodes_count);
-        log_debug("child pointers:   %8"PRIu64" bytes (%8"PRIu64")",
-                  t.children_count * sizeof(struct trie_child_entry_f), t.children_count);
-        log_debug("value pointers:   %8"PRIu64" bytes (%8"PRIu64")",
-                  t.values_count * sizeof(struct trie_value_entry_f), t.values_count);
+                  (uint64_t) (pos - header_size), t.nodes_count);
+        log_debug("child pointers:   %8"PRIu64, t.children_count);
+        log_debug("value pointers:   %8"PRIu64, t.values_count);
+        if (version >= 2)
+                log_debug("glob index:       %8zu entries (%8zu groups)", trie->globs_count, t.glob_nodes_count);
         log_debug("string store:     %8zu bytes", trie->strings->len);
         log_debug("strings start:    %8"PRIu64, t.strings_off);
 
         return 0;
 }
 
-static int insert_data(struct trie *trie, struct udev_list *match_list,
-                       char *line, const char *filename) {
+/*
+ * The files are parsed in parallel, each into a list of trie inserts. The
+ * inserts are applied in the order of the files, since later files
+ * override the properties of earlier ones.
+ */
+struct hwdb_insert {
+        const char *match;
+        const char *key;
+        const char *value;
+};
+
+struct hwdb_file {
+        const char *filename;
+        /* contents of the file, split into lines in place */
+        char *buf;
+        uint8_t hash[8];
+
+        struct hwdb_insert *inserts;
+        size_t n_inserts;
+        size_t allocated;
+};
+
+struct import_pool {
+        struct hwdb_file *files;
+        unsigned int n_files;
+        unsigned int next;
+};
+
+#define IMPORT_THREADS_MAX 16
+
+static const uint8_t hwdb_hash_key[16] = {
+        0x6b, 0x0e, 0x25, 0x9a, 0xd4, 0x3c, 0x41, 0x8f,
+        0xa2, 0x57, 0x13, 0xe8, 0x90, 0x7d, 0xc6, 0x31,
+};
+
+static int insert_data(struct hwdb_file *file, const char **matches, size_t n_matches, char *line) {
         char *value;
-        struct udev_list_entry *entry;
+        size_t i;
 
         assert(line[0] == ' ');
 
@@ -447,35 +799,79 @@ static int insert_data(struct trie *trie, struct udev_list *match_list,
                 return -EINVAL;
         }
 
-        udev_list_entry_foreach(entry, udev_list_get_entry(match_list))
-                trie_insert(trie, trie->root, udev_list_entry_get_name(entry), line, value);
+        if (!GREEDY_REALLOC(file->inserts, file->allocated, file->n_inserts + n_matches))
+                return -ENOMEM;
+
+        for (i = 0; i < n_matches; i++) {
+                file->inserts[file->n_inserts].match = matches[i];
+                file->inserts[file->n_inserts].key = line;
+                file->inserts[file->n_inserts].value = value;
+                file->n_inserts++;
+        }
+
+        return 0;
+}
+
+static int read_file(const char *filename, char **buf, size_t *size) {
+        _cleanup_fclose_ FILE *f = NULL;
+        struct stat st;
+        char *b;
+
+        f = fopen(filename, "re");
+        if (!f)
+                return -errno;
+
+        if (fstat(fileno(f), &st) < 0)
+                return -errno;
+
+        b = malloc(st.st_size + 1);
+        if (!b)
+                return -ENOMEM;
+
+        if (st.st_size > 0 && fread(b, st.st_size, 1, f) != 1) {
+                free(b);
+                return -EIO;
+        }
+        b[st.st_size] = '\0';
 
+        *buf = b;
+        *size = st.st_size;
         return 0;
 }
 
-static int import_file(struct udev *udev, struct trie *trie, const char *filename) {
+static int import_file(struct hwdb_file *file) {
         enum {
                 HW_MATCH,
                 HW_DATA,
                 HW_NONE,
         } state = HW_NONE;
-        FILE *f;
-        char line[LINE_MAX];
-        struct udev_list match_list;
-        uint32_t line_number = 0;
+        _cleanup_free_ const char **matches = NULL;
+        size_t n_matches = 0, matches_allocated = 0;
+        char *line, *next, *end;
+        size_t size;
         int r = 0, err;
 
-        udev_list_init(udev, &match_list, false);
+        err = read_file(file->filename, &file->buf, &size);
+        if (err < 0)
+                return err;
 
-        f = fopen(filename, "re");
-        if (!f)
-                return -errno;
+        siphash24(file->hash, file->buf, size, hwdb_hash_key);
 
-        while (fgets(line, sizeof(line), f)) {
+        end = file->buf + size;
+        for (line = file->buf; line < end; line = next + 1) {
                 size_t len;
                 char *pos;
 
-                ++line_number;
+                next = memchr(line, '\n', end - line);
+                if (!next)
+                        next = end;
+                next[0] = '\0';
+
+                if (next - line >= LINE_MAX) {
+                        log_error("Warning, line too long in %s, ignoring", file->filename);
+                        r = -EINVAL;
+                        continue;
+                }
 
                 /* comment line */
                 if (line[0] == '#')
@@ -505,7 +901,9 @@ static int import_file(struct udev *udev, struct trie *trie, const char *filenam
 
                         /* start of record, first match */
                         state = HW_MATCH;
-                        udev_list_entry_add(&match_list, line, NULL);
+                        if (!GREEDY_REALLOC(matches, matches_allocated, n_matches + 1))
+                                return -ENOMEM;
+                        matches[n_matches++] = line;
                         break;
 
                 case HW_MATCH:
@@ -513,19 +911,21 @@ static int import_file(struct udev *udev, struct trie *trie, const char *filenam
                                 log_error("Warning, property expected, ignoring record with no properties");
                                 r = -EINVAL;
                                 state = HW_NONE;
-                                udev_list_cleanup(&match_list);
+                                n_matches = 0;
                                 break;
                         }
 
                         if (line[0] != ' ') {
                                 /* another match */
-                                udev_list_entry_add(&match_list, line, NULL);
+                                if (!GREEDY_REALLOC(matches, matches_allocated, n_matches + 1))
+                                        return -ENOMEM;
+                                matches[n_matches++] = line;
                                 break;
                         }
 
                         /* first data */
                         state = HW_DATA;
-                        err = insert_data(trie, &match_list, line, filename);
+                        err = insert_data(file, matches, n_matches, line);
                         if (err < 0)
                                 r = err;
                         break;
@@ -534,7 +934,7 @@ static int import_file(struct udev *udev, struct trie *trie, const char *filenam
                         if (len == 0) {
                                 /* end of record */
                                 state = HW_NONE;
-                                udev_list_cleanup(&match_list);
+                                n_matches = 0;
                                 break;
                         }
 
@@ -542,11 +942,11 @@ static int import_file(struct udev *udev, struct trie *trie, const char *filenam
                                 log_error("Warning, property or empty line expected, got \"%s\", ignoring record", line);
                                 r = -EINVAL;
                                 state = HW_NONE;
-                                udev_list_cleanup(&match_list);
+                                n_matches = 0;
                                 break;
                         }
 
-                        err = insert_data(trie, &match_list, line, filename);
+                        err = insert_data(file, matches, n_matches, line);
                         if (err < 0)
                                 r = err;
                         break;
@@ -556,23 +956,373 @@ static int import_file(struct udev *udev, struct trie *trie, const char *filenam
         if (state == HW_MATCH)
                 log_error("Warning, property expected, ignoring record with no properties");
 
-        fclose(f);
-        udev_list_cleanup(&match_list);
         return r;
 }
 
+static void *import_worker_run(void *userdata) {
+        struct import_pool *pool = userdata;
+
+        for (;;) {
+                unsigned int i;
+
+                i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+                if (i >= pool->n_files)
+                        break;
+                log_debug("reading file '%s'", pool->files[i].filename);
+                import_file(&pool->files[i]);
+        }
+
+        return NULL;
+}
+
+static void import_files(struct hwdb_file *files, unsigned int n_files) {
+        struct import_pool pool = {
+                .files = files,
+                .n_files = n_files,
+        };
+        pthread_t threads[IMPORT_THREADS_MAX];
+        unsigned int n_threads, i;
+        long n_cpus;
+
+        n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = MIN(n_cpus > 0 ? (unsigned int) n_cpus : 1u, n_files);
+        n_threads = MIN(n_threads, (unsigned int) IMPORT_THREADS_MAX);
+
+        /* the calling thread takes part */
+        for (i = 1; i < n_threads; i++)
+                if (pthread_create(&threads[i], NULL, import_worker_run, &pool) != 0)
+                        break;
+        n_threads = i;
+
+        import_worker_run(&pool);
+
+        for (i = 1; i < n_threads; i++)
+                pthread_join(threads[i], NULL);
+}
+
+/* hash of the tool version, the format, and the names and contents of the files */
+static int sources_hash(struct hwdb_file *files, unsigned int n_files, unsigned int format, uint8_t hash[8]) {
+        _cleanup_free_ char *buf = NULL;
+        size_t size;
+        unsigned int i;
+        char *p;
+
+        size = strlen(VERSION) + 2;
+        for (i = 0; i < n_files; i++)
+                size += strlen(files[i].filename) + 1 + sizeof(files[i].hash);
+
+        buf = malloc(size);
+        if (!buf)
+                return -ENOMEM;
+
+        p = stpcpy(buf, VERSION) + 1;
+        *p++ = format;
+        for (i = 0; i < n_files; i++) {
+                p = stpcpy(p, files[i].filename) + 1;
+                p = mempcpy(p, files[i].hash, sizeof(files[i].hash));
+        }
+
+        siphash24(hash, buf, size, hwdb_hash_key);
+        return 0;
+}
+
+/* the existing database was built from the same sources */
+static bool trie_is_current(const char *filename, const uint8_t hash[8]) {
+        _cleanup_fclose_ FILE *f = NULL;
+        const char sig[] = HWDB_SIG;
+        const char sig_v2[] = HWDB_SIG_V2;
+        union {
+                struct trie_header_f h;
+                struct trie_header_f2 h2;
+        } head = {};
+        struct stat st;
+
+        f = fopen(filename, "re");
+        if (!f)
+                return false;
+
+        if (fstat(fileno(f), &st) < 0 ||
+            fread(&head, 1, sizeof(head), f) < MIN(sizeof(struct trie_header_f), sizeof(struct trie_header_f2)))
+                return false;
+
+        if (memcmp(head.h.signature, sig, sizeof(head.h.signature)) == 0)
+                return le64toh(head.h.file_size) == (uint64_t) st.st_size &&
+                       le64toh(head.h.header_size) >= sizeof(struct trie_header_f) &&
+                       memcmp(head.h.sources_hash, hash, sizeof(head.h.sources_hash)) == 0;
+
+        if (memcmp(head.h2.signature, sig_v2, sizeof(head.h2.signature)) == 0)
+                return le64toh(head.h2.file_size) == (uint64_t) st.st_size &&
+                       le32toh(head.h2.header_size) >= sizeof(struct trie_header_f2) &&
+                       memcmp(head.h2.sources_hash, hash, sizeof(head.h2.sources_hash)) == 0;
+
+        return false;
+}
+
+/* build the trie from the parsed files, and write it */
+static int trie_update(struct trie *trie, struct hwdb_file *files, unsigned int n_files,
+                       const char *filename, unsigned int format, const uint8_t hash[8]) {
+        unsigned int i;
+        size_t j;
+        int err;
+
+        for (i = 0; i < n_files; i++)
+                for (j = 0; j < files[i].n_inserts; j++)
+                        trie_insert(trie, trie->root, files[i].inserts[j].match,
+                                    files[i].inserts[j].key, files[i].inserts[j].value);
+
+        if (format >= 2) {
+                char pattern[LINE_MAX];
+
+                err = trie_collect_globs(trie, trie->root, NULL, pattern, 0);
+                if (err < 0)
+                        return err;
+        }
+
+        strbuf_complete(trie->strings);
+
+        log_debug("=== trie in-memory ===");
+        log_debug("nodes:            %8zu bytes (%8zu)",
+                  trie->nodes_count * sizeof(struct trie_node), trie->nodes_count);
+        log_debug("children arrays:  %8zu bytes (%8zu)",
+                  trie->children_count * sizeof(struct trie_child_entry), trie->children_count);
+        log_debug("values arrays:    %8zu bytes (%8zu)",
+                  trie->values_count * sizeof(struct trie_value_entry), trie->values_count);
+        log_debug("strings:          %8zu bytes",
+                  trie->strings->len);
+        log_debug("strings incoming: %8zu bytes (%8zu)",
+                  trie->strings->in_len, trie->strings->in_count);
+        log_debug("strings dedup'ed: %8zu bytes (%8zu)",
+                  trie->strings->dedup_len, trie->strings->dedup_count);
+
+        mkdir_parents(filename, 0755);
+        return trie_store(trie, filename, format, hash);
+}
+
+static int batch_print(struct udev_hwdb *hwdb, size_t index, struct udev_list_entry *list, void *userdata) {
+        const char **keys = userdata;
+        struct udev_list_entry *entry;
+
+        printf("K: %s\n", keys[index]);
+        udev_list_entry_foreach(entry, list)
+                printf("E: %s=%s\n", udev_list_entry_get_name(entry), udev_list_entry_get_value(entry));
+        printf("\n");
+        return 0;
+}
+
+/*
+ * Read lookup keys from stdin, one per line. Every chunk of complete lines
+ * which is read is looked up at once, and the results are written before
+ * the next read. Every result is a block of a "K: <key>" line, followed by
+ * "E: <property>=<value>" lines, and an empty line.
+ */
+static int hwdb_batch(struct udev *udev) {
+        struct udev_hwdb *hwdb;
+        char buf[64 * 1024];
+        _cleanup_free_ const char **keys = NULL;
+        size_t keys_allocated = 0;
+        size_t len = 0;
+        bool eof = false;
+        int r = 0;
+
+        hwdb = udev_hwdb_new(udev);
+        if (!hwdb)
+                return -ENOENT;
+
+        while (!eof) {
+                size_t n_keys = 0;
+                char *line, *end;
+                ssize_t k;
+
+                k = read(STDIN_FILENO, buf + len, sizeof(buf) - 1 - len);
+                if (k < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        r = -errno;
+                        break;
+                }
+                eof = k == 0;
+                len += k;
+                buf[len] = '\0';
+
+                for (line = buf; (end = memchr(line, '\n', buf + len - line)); line = end + 1) {
+                        end[0] = '\0';
+                        if (!GREEDY_REALLOC(keys, keys_allocated, n_keys + 1)) {
+                                r = -ENOMEM;
+                                goto out;
+                        }
+                        keys[n_keys++] = line;
+                }
+
+                /* the last line without newline */
+                if (eof && line < buf + len) {
+                        if (!GREEDY_REALLOC(keys, keys_allocated, n_keys + 1)) {
+                                r = -ENOMEM;
+                                goto out;
+                        }
+                        keys[n_keys++] = line;
+                        line = buf + len;
+                }
+
+                if (n_keys == 0 && len == sizeof(buf) - 1) {
+                        r = -ENOBUFS;
+                        break;
+                }
+
+                r = udev_hwdb_lookup_batch(hwdb, keys, n_keys, batch_print, keys);
+                if (r < 0)
+                        break;
+                fflush(stdout);
+
+                len -= line - buf;
+                memmove(buf, line, len);
+        }
+out:
+        udev_hwdb_unref(hwdb);
+        return r;
+}
+
+static int hwdb_stats(struct udev *udev) {
+        static const char * const fanout[UDEV_HWDB_FANOUT_BUCKETS] = {
+                "0", "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64-127", "128-255",
+        };
+        struct udev_hwdb_stats stats;
+        struct udev_hwdb *hwdb;
+        unsigned int i;
+        int r;
+
+        hwdb = udev_hwdb_new(udev);
+        if (!hwdb)
+                return -ENOENT;
+        r = udev_hwdb_get_stats(hwdb, &stats);
+        udev_hwdb_unref(hwdb);
+        if (r < 0)
+                return r;
+
+        printf("format version:  %8u\n", stats.version);
+        printf("file size:       %8"PRIu64" bytes\n", stats.file_size);
+        printf("nodes section:   %8"PRIu64" bytes\n", stats.nodes_len);
+        printf("string section:  %8"PRIu64" bytes\n", stats.strings_len);
+        printf("nodes:           %8"PRIu64"\n", stats.nodes);
+        printf("values:          %8"PRIu64" (%"PRIu64" nodes)\n", stats.values, stats.value_nodes);
+        printf("glob nodes:      %8"PRIu64"\n", stats.glob_nodes);
+        printf("glob index:      %8"PRIu64" entries (%"PRIu64" groups)\n", stats.glob_entries, stats.glob_groups);
+        printf("depth:           %8u max, %.1f average of nodes with values\n", stats.depth_max,
+               stats.value_nodes > 0 ? (double) stats.depth_sum / stats.value_nodes : 0.0);
+        printf("fanout:\n");
+        for (i = 0; i < UDEV_HWDB_FANOUT_BUCKETS; i++)
+                printf("  %7s children: %8"PRIu64" nodes\n", fanout[i], stats.fanout[i]);
+
+        return 0;
+}
+
+static int uint64_cmp(const void *a, const void *b) {
+        uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+        return x < y ? -1 : x > y;
+}
+
+/* value at the given per mille of a sorted array */
+static uint64_t percentile(const uint64_t *sorted, size_t n, unsigned int permille) {
+        return sorted[MIN(n * permille / 1000, n - 1)];
+}
+
+/* replay the lookup keys from a file, one per line, and report the cost of every lookup */
+static int hwdb_bench(struct udev *udev, const char *filename) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_strv_free_ char **keys = NULL;
+        _cleanup_free_ uint64_t *nsec = NULL;
+        _cleanup_free_ uint64_t *nodes = NULL;
+        struct udev_hwdb *hwdb;
+        char line[LINE_MAX];
+        uint64_t nsec_sum = 0, nodes_sum = 0;
+        size_t n, i;
+        int r;
+
+        f = fopen(filename, "re");
+        if (!f)
+                return -errno;
+        while (fgets(line, sizeof(line), f)) {
+                line[strcspn(line, "\n")] = '\0';
+                r = strv_extend(&keys, line);
+                if (r < 0)
+                        return r;
+        }
+
+        n = strv_length(keys);
+        if (n == 0)
+                return -ENODATA;
+        nsec = new(uint64_t, n);
+        nodes = new(uint64_t, n);
+        if (!nsec || !nodes)
+                return -ENOMEM;
+
+        hwdb = udev_hwdb_new(udev);
+        if (!hwdb)
+                return -ENOENT;
+
+        for (i = 0; i < n; i++) {
+                struct timespec a, b;
+
+                clock_gettime(CLOCK_MONOTONIC, &a);
+                udev_hwdb_get_properties_list_entry(hwdb, keys[i], 0);
+                clock_gettime(CLOCK_MONOTONIC, &b);
+
+                nsec[i] = (b.tv_sec - a.tv_sec) * NSEC_PER_SEC + b.tv_nsec - a.tv_nsec;
+                nodes[i] = udev_hwdb_get_nodes_visited(hwdb);
+                nsec_sum += nsec[i];
+                nodes_sum += nodes[i];
+        }
+        udev_hwdb_unref(hwdb);
+
+        qsort(nsec, n, sizeof(uint64_t), uint64_cmp);
+        qsort(nodes, n, sizeof(uint64_t), uint64_cmp);
+
+        printf("lookups:         %8zu\n", n);
+        printf("total:           %8.1f ms\n", (double) nsec_sum / NSEC_PER_MSEC);
+        printf("latency (us):    mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n",
+               (double) nsec_sum / n / NSEC_PER_USEC,
+               (double) percentile(nsec, n, 500) / NSEC_PER_USEC,
+               (double) percentile(nsec, n, 900) / NSEC_PER_USEC,
+               (double) percentile(nsec, n, 990) / NSEC_PER_USEC,
+               (double) percentile(nsec, n, 999) / NSEC_PER_USEC,
+               (double) nsec[n - 1] / NSEC_PER_USEC);
+        printf("nodes visited:   mean %.1f, p50 %"PRIu64", p90 %"PRIu64", p99 %"PRIu64", max %"PRIu64"\n",
+               (double) nodes_sum / n,
+               percentile(nodes, n, 500), percentile(nodes, n, 900),
+               percentile(nodes, n, 990), nodes[n - 1]);
+
+        return 0;
+}
+
 static void help(void) {
         printf("Usage: udevadm hwdb OPTIONS\n"
                "  -u,--update          update the hardware database\n"
+               "     --format=VERSION  file format to write, 1 (default) or 2\n"
+               "     --incremental     skip the update if the files did not change\n"
                "  -t,--test=MODALIAS   query database and print result\n"
+               "     --batch           query database for keys read from stdin\n"
+               "     --stats           print statistics about the database\n"
+               "     --bench=FILE      measure the lookup of the keys in a file\n"
                "  -r,--root=PATH       alternative root path in the filesystem\n"
                "  -h,--help\n\n");
 }
 
 static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
+        enum {
+                ARG_FORMAT = 0x100,
+                ARG_INCREMENTAL,
+                ARG_BATCH,
+                ARG_STATS,
+                ARG_BENCH,
+        };
         static const struct option options[] = {
                 { "update", no_argument,       NULL, 'u' },
+                { "format", required_argument, NULL, ARG_FORMAT },
+                { "incremental", no_argument,  NULL, ARG_INCREMENTAL },
                 { "test",   required_argument, NULL, 't' },
+                { "batch",  no_argument,       NULL, ARG_BATCH },
+                { "stats",  no_argument,       NULL, ARG_STATS },
+                { "bench",  required_argument, NULL, ARG_BENCH },
                 { "root",   required_argument, NULL, 'r' },
                 { "help",   no_argument,       NULL, 'h' },
                 {}
@@ -580,6 +1330,11 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
         const char *test = NULL;
         const char *root = "";
         bool update = false;
+        bool incremental = false;
+        bool batch = false;
+        bool stats = false;
+        const char *bench = NULL;
+        unsigned int format = 1;
         struct trie *trie = NULL;
         int err, c;
         int rc = EXIT_SUCCESS;
@@ -589,9 +1344,31 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                 case 'u':
                         update = true;
                         break;
+                case ARG_FORMAT:
+                        if (streq(optarg, "1"))
+                                format = 1;
+                        else if (streq(optarg, "2"))
+                                format = 2;
+                        else {
+                                log_error("Unknown format '%s'", optarg);
+                                return EXIT_FAILURE;
+                        }
+                        break;
+                case ARG_INCREMENTAL:
+                        incremental = true;
+                        break;
                 case 't':
                         test = optarg;
                         break;
+                case ARG_BATCH:
+                        batch = true;
+                        break;
+                case ARG_STATS:
+                        stats = true;
+                        break;
+                case ARG_BENCH:
+                        bench = optarg;
+                        break;
                 case 'r':
                         root = optarg;
                         break;
@@ -604,14 +1381,22 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                         assert_not_reached("Unknown option");
                 }
 
-        if (!update && !test) {
-                log_error("Either --update or --test must be used");
+        if (!update && !test && !batch && !stats && !bench) {
+                log_error("Either --update, --test, --batch, --stats or --bench must be used");
                 return EXIT_FAILURE;
         }
 
         if (update) {
-                char **files, **f;
-                _cleanup_free_ char *hwdb_bin = UDEV_HWDB_BIN;
+                char **files;
+                _cleanup_free_ char *hwdb_bin = NULL;
+                struct hwdb_file *hwdb_files;
+                unsigned int n_files, i;
+                uint8_t hash[8];
+
+                if (asprintf(&hwdb_bin, "%s/%s", root, UDEV_HWDB_BIN) < 0) {
+                        rc = EXIT_FAILURE;
+                        goto out;
+                }
 
                 trie = new0(struct trie, 1);
                 if (!trie) {
@@ -627,7 +1412,7 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                 }
 
                 /* index */
-                trie->root = new0(struct trie_node, 1);
+                trie->root = trie_node_new();
                 if (!trie->root) {
                         rc = EXIT_FAILURE;
                         goto out;
@@ -640,38 +1425,34 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                         rc = EXIT_FAILURE;
                         goto out;
                 }
-                STRV_FOREACH(f, files) {
-                        log_debug("reading file '%s'", *f);
-                        import_file(udev, trie, *f);
-                }
-                strv_free(files);
-
-                strbuf_complete(trie->strings);
-
-                log_debug("=== trie in-memory ===");
-                log_debug("nodes:            %8zu bytes (%8zu)",
-                          trie->nodes_count * sizeof(struct trie_node), trie->nodes_count);
-                log_debug("children arrays:  %8zu bytes (%8zu)",
-                          trie->children_count * sizeof(struct trie_child_entry), trie->children_count);
-                log_debug("values arrays:    %8zu bytes (%8zu)",
-                          trie->values_count * sizeof(struct trie_value_entry), trie->values_count);
-                log_debug("strings:          %8zu bytes",
-                          trie->strings->len);
-                log_debug("strings incoming: %8zu bytes (%8zu)",
-                          trie->strings->in_len, trie->strings->in_count);
-                log_debug("strings dedup'ed: %8zu bytes (%8zu)",
-                          trie->strings->dedup_len, trie->strings->dedup_count);
-
-                if (asprintf(&hwdb_bin, "%s/%s", root, hwdb_bin) < 0) {
+                n_files = strv_length(files);
+                hwdb_files = new0(struct hwdb_file, n_files);
+                if (!hwdb_files) {
+                        strv_free(files);
                         rc = EXIT_FAILURE;
                         goto out;
                 }
-                mkdir_parents(hwdb_bin, 0755);
-                err = trie_store(trie, hwdb_bin);
+                for (i = 0; i < n_files; i++)
+                        hwdb_files[i].filename = files[i];
+
+                import_files(hwdb_files, n_files);
+
+                err = sources_hash(hwdb_files, n_files, format, hash);
+                if (err >= 0 && incremental && trie_is_current(hwdb_bin, hash))
+                        log_debug("%s is up to date", hwdb_bin);
+                else if (err >= 0)
+                        err = trie_update(trie, hwdb_files, n_files, hwdb_bin, format, hash);
                 if (err < 0) {
                         log_error_errno(err, "Failure writing database %s: %m", hwdb_bin);
                         rc = EXIT_FAILURE;
                 }
+
+                for (i = 0; i < n_files; i++) {
+                        free(hwdb_files[i].buf);
+                        free(hwdb_files[i].inserts);
+                }
+                free(hwdb_files);
+                strv_free(files);
         }
 
         if (test) {
@@ -685,10 +1466,35 @@ static int adm_hwdb(struct udev *udev, int argc, char *argv[]) {
                         udev_hwdb_unref(hwdb);
                 }
         }
+
+        if (batch) {
+                err = hwdb_batch(udev);
+                if (err < 0) {
+                        log_error_errno(err, "Failure querying the database: %m");
+                        rc = EXIT_FAILURE;
+                }
+        }
+
+        if (stats) {
+                err = hwdb_stats(udev);
+                if (err < 0) {
+                        log_error_errno(err, "Failure reading the database: %m");
+                        rc = EXIT_FAILURE;
+                }
+        }
+
+        if (bench) {
+                err = hwdb_bench(udev, bench);
+                if (err < 0) {
+                        log_error_errno(err, "Failure running the benchmark with %s: %m", bench);
+                        rc = EXIT_FAILURE;
+                }
+        }
 out:
         if (trie) {
                 if (trie->root)
                         trie_node_cleanup(trie->root);
+                mempool_drop(&trie_node_pool);
                 strbuf_cleanup(trie->strings);
                 free(trie);
         }
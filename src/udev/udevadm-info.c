@@ -202,7 +202,8 @@ static void cleanup_dir(DIR *dir, mode_t mask, int depth) {
         for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
                 struct stat stats;
 
-                if (dent->d_name[0] == '.')
+                /* hidden temporary files are removed too */
+                if (streq(dent->d_name, ".") || streq(dent->d_name, ".."))
                         continue;
                 if (fstatat(dirfd(dir), dent->d_name, &stats, AT_SYMLINK_NOFOLLOW) != 0)
                         continue;
@@ -244,6 +245,19 @@ static void cleanup_db(struct udev *udev) {
                 closedir(dir);
         }
 
+        dir = opendir(UDEV_ROOT_RUN "/udev/tags-index");
+        if (dir != NULL) {
+                cleanup_dir(dir, 0, 1);
+                closedir(dir);
+        }
+
+        /* <key>/<value>/<device id>, and .indexed/<key> */
+        dir = opendir(UDEV_ROOT_RUN "/udev/property");
+        if (dir != NULL) {
+                cleanup_dir(dir, 0, 3);
+                closedir(dir);
+        }
+
         dir = opendir(UDEV_ROOT_RUN "/udev/static_node-tags");
         if (dir != NULL) {
                 cleanup_dir(dir, 0, 2);
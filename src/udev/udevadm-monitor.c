@@ -256,22 +256,22 @@ static int adm_monitor(struct udev *udev, int argc, char *argv[]) {
                 }
 
                 for (i = 0; i < fdcount; i++) {
-                        if (ev[i].data.fd == fd_kernel && ev[i].events & EPOLLIN) {
-                                struct udev_device *device;
+                        struct udev_device *devices[32];
+                        const char *source;
+                        int n, k;
 
-                                device = udev_monitor_receive_device(kernel_monitor);
-                                if (device == NULL)
-                                        continue;
-                                print_device(device, "KERNEL", prop);
-                                udev_device_unref(device);
+                        if (ev[i].data.fd == fd_kernel && ev[i].events & EPOLLIN) {
+                                n = udev_monitor_receive_devices(kernel_monitor, devices, ELEMENTSOF(devices));
+                                source = "KERNEL";
                         } else if (ev[i].data.fd == fd_udev && ev[i].events & EPOLLIN) {
-                                struct udev_device *device;
-
-                                device = udev_monitor_receive_device(udev_monitor);
-                                if (device == NULL)
-                                        continue;
-                                print_device(device, "UDEV", prop);
-                                udev_device_unref(device);
+                                n = udev_monitor_receive_devices(udev_monitor, devices, ELEMENTSOF(devices));
+                                source = "UDEV";
+                        } else
+                                continue;
+
+                        for (k = 0; k < n; k++) {
+                                print_device(devices[k], source, prop);
+                                udev_device_unref(devices[k]);
                         }
                 }
         }
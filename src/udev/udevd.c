@@ -71,6 +71,9 @@ static unsigned arg_children_max;
 static int arg_exec_delay;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
+static char *arg_property_index;
+static char **property_index_pending;
+static bool tag_index_pending = true;
 static sigset_t sigmask_orig;
 static UDEV_LIST(event_list);
 Hashmap *workers;
@@ -960,12 +963,19 @@ static void handle_signal(struct udev *udev, int signo) {
                                 log_warning("worker ["PID_FMT"] exit with status 0x%04x", pid, status);
                         }
 
+                        if (!WIFEXITED(status)) {
+                                /* a record might be cut off */
+                                tag_index_invalidate();
+                                tag_index_pending = true;
+                        }
+
                         if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
                                 if (worker->event) {
                                         log_error("worker ["PID_FMT"] failed while handling '%s'", pid, worker->event->devpath);
                                         /* delete state from disk */
                                         udev_device_delete_db(worker->event->dev);
                                         udev_device_tag_index(worker->event->dev, NULL, false);
+                                        udev_device_property_index(worker->event->dev, NULL, false);
                                         /* forward kernel event without amending it */
                                         udev_monitor_send_device(monitor, NULL, worker->event->dev_kernel);
                                 }
@@ -986,6 +996,7 @@ static void handle_signal(struct udev *udev, int signo) {
  *   udev.children-max=<number of workers>     events are fully serialized if set to 1
  *   udev.exec-delay=<number of seconds>       delay execution of every executed program
  *   udev.event-timeout=<number of seconds>    seconds to wait before terminating an event
+ *   udev.property-index=<key>[,<key>...]      properties to maintain an index of
  */
 static int parse_proc_cmdline_item(const char *key, const char *value) {
         int r;
@@ -1024,11 +1035,154 @@ static int parse_proc_cmdline_item(const char *key, const char *value) {
                         arg_event_timeout_usec *= USEC_PER_SEC;
                         arg_event_timeout_warn_usec = (arg_event_timeout_usec / 3) ? : 1;
                 }
+        } else if (streq(key, "property-index")) {
+                free(arg_property_index);
+                arg_property_index = strdup(value);
+                if (!arg_property_index)
+                        return log_oom();
         }
 
         return 0;
 }
 
+#define PROPERTY_INDEX_DEFAULT "ID_SERIAL,ID_PATH,ID_FS_UUID,DM_NAME"
+#define PROPERTY_INDEX_SEPARATOR "," WHITESPACE
+
+static bool property_index_has_key(const char *keys, const char *key) {
+        const char *word, *state;
+        size_t l;
+
+        _FOREACH_WORD(word, l, keys, PROPERTY_INDEX_SEPARATOR, false, state)
+                if (strlen(key) == l && strneq(word, key, l))
+                        return true;
+        return false;
+}
+
+static void property_index_remove_key(int dfd, const char *key) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *dent;
+        int fd;
+
+        fd = openat(dfd, key, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+        if (fd < 0)
+                return;
+        dir = fdopendir(fd);
+        if (!dir) {
+                close(fd);
+                return;
+        }
+
+        /* <key>/<value>/<device id> */
+        for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                _cleanup_closedir_ DIR *value_dir = NULL;
+                struct dirent *id;
+                int value_fd;
+
+                if (dent->d_name[0] == '.')
+                        continue;
+
+                value_fd = openat(dirfd(dir), dent->d_name, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+                if (value_fd < 0)
+                        continue;
+                value_dir = fdopendir(value_fd);
+                if (!value_dir) {
+                        close(value_fd);
+                        continue;
+                }
+                for (id = readdir(value_dir); id != NULL; id = readdir(value_dir))
+                        if (id->d_name[0] != '.')
+                                unlinkat(value_fd, id->d_name, 0);
+                unlinkat(dirfd(dir), dent->d_name, AT_REMOVEDIR);
+        }
+
+        unlinkat(dfd, key, AT_REMOVEDIR);
+}
+
+/*
+ * The keys of the property index are the directories in /run/udev/property/,
+ * which are maintained by the workers like the tag index. The index of keys
+ * which are no longer configured is dropped, since it would not be updated
+ * anymore. Newly configured keys get the devices in the database indexed
+ * when udevd is idle for the first time, after the queued events, usually
+ * the coldplug, have been handled; only then /run/udev/property/.indexed/<key>
+ * marks the index of the key as complete, and enumerators use it.
+ */
+static void property_index_setup(const char *keys) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        _cleanup_closedir_ DIR *dir_indexed = NULL;
+        const char *word, *state;
+        size_t l;
+
+        dir = opendir(UDEV_ROOT_RUN "/udev/property");
+        if (dir) {
+                struct dirent *dent;
+
+                for (dent = readdir(dir); dent != NULL; dent = readdir(dir)) {
+                        if (dent->d_name[0] == '.')
+                                continue;
+                        if (property_index_has_key(keys, dent->d_name))
+                                continue;
+                        log_debug("dropping property index of '%s'", dent->d_name);
+                        property_index_remove_key(dirfd(dir), dent->d_name);
+                }
+        }
+
+        /* drop the marks of dropped keys */
+        dir_indexed = opendir(UDEV_ROOT_RUN "/udev/property/.indexed");
+        if (dir_indexed) {
+                struct dirent *dent;
+
+                for (dent = readdir(dir_indexed); dent != NULL; dent = readdir(dir_indexed)) {
+                        if (dent->d_name[0] == '.')
+                                continue;
+                        if (!property_index_has_key(keys, dent->d_name))
+                                unlinkat(dirfd(dir_indexed), dent->d_name, 0);
+                }
+        }
+
+        _FOREACH_WORD(word, l, keys, PROPERTY_INDEX_SEPARATOR, false, state) {
+                char path[UTIL_PATH_SIZE];
+                char key[UTIL_NAME_SIZE];
+
+                if (l >= sizeof(key))
+                        continue;
+                memcpy(key, word, l);
+                key[l] = '\0';
+                if (key[0] == '.' || strchr(key, '/')) {
+                        log_warning("invalid property index key '%s' ignored", key);
+                        continue;
+                }
+                strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/property/", key, NULL);
+                udev_mkdir_p(path, 0755);
+
+                strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/property/.indexed/", key, NULL);
+                if (access(path, F_OK) < 0 && strv_extend(&property_index_pending, key) < 0)
+                        return;
+        }
+}
+
+static void property_index_complete(void) {
+        char **key;
+        int r;
+
+        if (strv_isempty(property_index_pending))
+                return;
+
+        r = property_index_fill(property_index_pending);
+        if (r < 0)
+                log_warning_errno(r, "could not index the devices by their properties: %m");
+        else
+                STRV_FOREACH(key, property_index_pending) {
+                        char path[UTIL_PATH_SIZE];
+
+                        log_debug("property index of '%s' is complete", *key);
+                        strscpyl(path, sizeof(path), UDEV_ROOT_RUN "/udev/property/.indexed/", *key, NULL);
+                        touch_file(path, true, USEC_INFINITY, UID_INVALID, GID_INVALID, 0);
+                }
+
+        property_index_pending = strv_free(property_index_pending);
+}
+
 static void help(void) {
         printf("%s [OPTIONS...]\n\n"
                "Manages devices.\n\n"
@@ -1041,6 +1195,8 @@ static void help(void) {
                "  -t --event-timeout=SECONDS  Seconds to wait before terminating an event\n"
                "  -N --resolve-names=early|late|never\n"
                "                              When to resolve users and groups\n"
+               "  -p --property-index=KEY[,KEY...]\n"
+               "                              Properties to maintain an index of\n"
                , program_invocation_short_name);
 }
 
@@ -1052,6 +1208,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "exec-delay",         required_argument,      NULL, 'e' },
                 { "event-timeout",      required_argument,      NULL, 't' },
                 { "resolve-names",      required_argument,      NULL, 'N' },
+                { "property-index",     required_argument,      NULL, 'p' },
                 { "help",               no_argument,            NULL, 'h' },
                 { "version",            no_argument,            NULL, 'V' },
                 {}
@@ -1062,7 +1219,7 @@ static int parse_argv(int argc, char *argv[]) {
         assert(argc >= 0);
         assert(argv);
 
-        while ((c = getopt_long(argc, argv, "c:de:Dt:N:hV", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "c:de:Dt:N:p:hV", options, NULL)) >= 0) {
                 int r;
 
                 switch (c) {
@@ -1104,6 +1261,12 @@ static int parse_argv(int argc, char *argv[]) {
                                 return 0;
                         }
                         break;
+                case 'p':
+                        free(arg_property_index);
+                        arg_property_index = strdup(optarg);
+                        if (!arg_property_index)
+                                return log_oom();
+                        break;
                 case 'h':
                         help();
                         return 0;
@@ -1187,6 +1350,12 @@ int main(int argc, char *argv[]) {
 
         dev_setup(NULL, UID_INVALID, GID_INVALID);
 
+        property_index_setup(arg_property_index ?: PROPERTY_INDEX_DEFAULT);
+
+        r = tag_index_setup();
+        if (r < 0)
+                log_warning_errno(r, "could not set up the tag index: %m");
+
         /* before opening new files, make sure std{in,out,err} fds are in a sane state */
         if (arg_daemonize) {
                 int fd;
@@ -1392,8 +1561,11 @@ int main(int argc, char *argv[]) {
                         /* timeout at exit for workers to finish */
                         timeout = 30 * MSEC_PER_SEC;
                 } else if (udev_list_node_is_empty(&event_list) && hashmap_isempty(workers)) {
-                        /* we are idle */
-                        timeout = -1;
+                        /* we are idle, but the indexes may still need to be built */
+                        if (tag_index_pending || !strv_isempty(property_index_pending))
+                                timeout = 3 * MSEC_PER_SEC;
+                        else
+                                timeout = -1;
                 } else {
                         /* kill idle or hanging workers */
                         timeout = 3 * MSEC_PER_SEC;
@@ -1420,6 +1592,9 @@ int main(int argc, char *argv[]) {
                         if (udev_list_node_is_empty(&event_list)) {
                                 log_debug("cleanup idle workers");
                                 worker_kill();
+                                tag_index_compact(udev);
+                                tag_index_pending = false;
+                                property_index_complete();
                         }
 
                         /* check for hanging events */
@@ -1487,13 +1662,15 @@ int main(int argc, char *argv[]) {
                         worker_returned(fd_worker);
 
                 if (is_netlink) {
-                        struct udev_device *dev;
-
-                        dev = udev_monitor_receive_device(monitor);
-                        if (dev) {
-                                udev_device_ensure_usec_initialized(dev, NULL);
-                                if (event_queue_insert(dev) < 0)
-                                        udev_device_unref(dev);
+                        struct udev_device *devs[32];
+                        int n, k;
+
+                        /* queue all pending uevents, not only one per wakeup */
+                        n = udev_monitor_receive_devices(monitor, devs, ELEMENTSOF(devs));
+                        for (k = 0; k < n; k++) {
+                                udev_device_ensure_usec_initialized(devs[k], NULL);
+                                if (event_queue_insert(devs[k]) < 0)
+                                        udev_device_unref(devs[k]);
                         }
                 }
 
@@ -1565,6 +1742,8 @@ exit:
         udev_ctrl_connection_unref(udev_ctrl_conn);
         udev_ctrl_unref(udev_ctrl);
         mac_selinux_finish();
+        free(arg_property_index);
+        strv_free(property_index_pending);
         udev_unref(udev);
         log_close();
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
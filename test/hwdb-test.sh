@@ -0,0 +1,54 @@
+#!/bin/sh
+# Build a hardware database with many overlapping glob patterns in both
+# file formats, and check that lookups in both return the same properties.
+
+[ -n "$udevhwdbdir" ] && [ -n "$udevhwdbbin" ] || {
+        echo "$0: udevhwdbdir and udevhwdbbin are not set, skipping"
+        exit 77
+}
+
+udevadm=../src/udev/udevadm
+tmp=`mktemp -d` || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/v1$udevhwdbdir" "$tmp/v2$udevhwdbdir" || exit 1
+src="$tmp/v1$udevhwdbdir"
+
+# patterns with '*', '?' and character classes at every position of the key
+for d in 0 1 2 3 4 5 6 7 8 9 A B C D E F; do
+        printf 'usb:v%s*\n ID_VENDOR_DIGIT=%s\n\n' $d $d
+        printf 'usb:v?%s*\n ID_VENDOR_SECOND=%s\n\n' $d $d
+        printf 'usb:v*p%s???*\n ID_PRODUCT_DIGIT=%s\n\n' $d $d
+        printf 'usb:v*p*d%s*\n ID_REVISION_DIGIT=%s\n\n' $d $d
+        printf 'usb:v[0-7]*p*%s\n ID_CLASS_LOW=%s\n\n' $d $d
+        printf 'usb:v[!0-7]*p*dc%s*\n ID_CLASS_HIGH=%s\n\n' $d $d
+        printf 'usb:*dsc%s?dp*\n ID_SUBCLASS=%s\n ID_MATCH=subclass\n\n' $d $d
+        printf 'usb:v%s%s*p*\nusb:v*p%s%s*\n ID_DOUBLE=%s\n\n' $d $d $d $d $d
+done > "$src/50-glob.hwdb"
+
+# exact and glob keys setting the same properties, later ones win
+for v in 0000 0001 0010 0100 1000 1D6B 8086 FFFF; do
+        printf 'usb:v%sp0001*\n ID_MATCH=product\n ID_VENDOR_DIGIT=exact\n\n' $v
+        printf 'usb:v%s*\n ID_MATCH=vendor\n\n' $v
+done > "$src/60-override.hwdb"
+printf 'usb:*\n ID_ANY=1\n\nusb:v*p*d*dc*dsc*dp*\n ID_ANY=2\n\n' > "$src/70-any.hwdb"
+
+cp "$src"/*.hwdb "$tmp/v2$udevhwdbdir" || exit 1
+$udevadm hwdb --update --format=1 --root="$tmp/v1" || exit 1
+$udevadm hwdb --update --format=2 --root="$tmp/v2" || exit 1
+
+set --
+for v in 0000 0001 0010 0100 1000 1D6B 2A3F 8086 C0DE FFFF; do
+        for p in 0000 0001 5A5A F00F; do
+                set -- "$@" "usb:v${v}p${p}d0100dc00dsc00dp00" "usb:v${v}p${p}d9F01dcFFdsc3Edp01" "usb:v${v}p${p}"
+        done
+done
+set -- "$@" "usb:" "usb:v" "pci:v00008086" "nonexistent"
+
+./test-libudev --hwdb="$tmp/v1$udevhwdbbin" --hwdb="$tmp/v2$udevhwdbbin" "$@" > "$tmp/result" || exit 1
+
+# the database is not empty
+grep -q '^ID_MATCH=product$' "$tmp/result" && grep -q '^ID_DOUBLE=0$' "$tmp/result" || {
+        echo "$0: lookups returned unexpected properties"
+        exit 1
+}
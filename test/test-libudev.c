@@ -30,8 +30,11 @@
 #include <sys/sysmacros.h>
 
 #include "libudev.h"
+#include "libudev-private.h"
 #include "udev-util.h"
 #include "util.h"
+#include "set.h"
+#include "strv.h"
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
@@ -294,6 +297,197 @@ out:
         return 0;
 }
 
+static const char * const filter_devices[] = { "null", "zero", "full", "random" };
+
+/* send all devices to the receiver, and compare the sysnames of the devices passing the filter */
+static void monitor_filter_check(struct udev_monitor *sender, struct udev_monitor *receiver,
+                                 struct udev_device **devices, const char *expected) {
+        struct udev_device *device;
+        char received[256] = "";
+        size_t len = 0;
+        unsigned int i;
+
+        /* filters which do not fit into the socket filter are applied by the library */
+        assert_se(udev_monitor_filter_update(receiver) >= 0);
+        assert_se(udev_monitor_enable_receiving(receiver) >= 0);
+        udev_monitor_allow_unicast_sender(receiver, sender);
+
+        for (i = 0; i < ELEMENTSOF(filter_devices); i++)
+                assert_se(udev_monitor_send_device(sender, receiver, devices[i]) > 0);
+
+        while ((device = udev_monitor_receive_device(receiver)) != NULL) {
+                len += snprintf(received + len, sizeof(received) - len, "%s%s",
+                                len > 0 ? " " : "", udev_device_get_sysname(device));
+                udev_device_unref(device);
+        }
+        printf("received '%s', expected '%s'\n", received, expected);
+        assert_se(streq(received, expected));
+}
+
+static struct udev_monitor *monitor_filter_new(struct udev *udev) {
+        struct udev_monitor *receiver;
+
+        receiver = udev_monitor_new_from_netlink(udev, "udev");
+        assert_se(receiver != NULL);
+        return receiver;
+}
+
+/* receive the messages which pass the filter in batches */
+static void test_monitor_receive_devices(struct udev_monitor *sender, struct udev_monitor *receiver,
+                                         struct udev_device **devices) {
+        static const char * const expected[] = { "null", "zero", "random", "null", "zero", "random" };
+        struct udev_device *received[4];
+        unsigned int i, n = 0;
+        int r;
+
+        assert_se(udev_monitor_enable_receiving(receiver) >= 0);
+        udev_monitor_allow_unicast_sender(receiver, sender);
+        assert_se(udev_monitor_receive_devices(receiver, received, ELEMENTSOF(received)) == -EAGAIN);
+
+        /* every batch is filled up, as long as messages are queued */
+        for (i = 0; i < 2 * ELEMENTSOF(filter_devices); i++)
+                assert_se(udev_monitor_send_device(sender, receiver, devices[i % ELEMENTSOF(filter_devices)]) > 0);
+        while ((r = udev_monitor_receive_devices(receiver, received, ELEMENTSOF(received))) > 0) {
+                printf("received %i devices\n", r);
+                assert_se(n > 0 || r == ELEMENTSOF(received));
+                for (i = 0; i < (unsigned int) r; i++) {
+                        assert_se(n < ELEMENTSOF(expected));
+                        assert_se(streq(udev_device_get_sysname(received[i]), expected[n]));
+                        udev_device_unref(received[i]);
+                        n++;
+                }
+        }
+        assert_se(r == -EAGAIN);
+        assert_se(n == ELEMENTSOF(expected));
+
+        /* no pending message passes the filter of the library */
+        assert_se(udev_monitor_send_device(sender, receiver, devices[2]) > 0);
+        assert_se(udev_monitor_receive_devices(receiver, received, ELEMENTSOF(received)) == 0);
+        assert_se(udev_monitor_receive_devices(receiver, received, ELEMENTSOF(received)) == -EAGAIN);
+}
+
+static void test_monitor_filter(struct udev *udev) {
+        struct udev_device *devices[ELEMENTSOF(filter_devices)];
+        struct udev_monitor *sender, *receiver;
+        char name[64];
+        unsigned int i;
+
+        /* messages are only accepted from root */
+        if (geteuid() != 0) {
+                printf("monitor filter: skipped, needs root\n\n");
+                return;
+        }
+
+        sender = udev_monitor_new_from_netlink(udev, NULL);
+        assert_se(sender != NULL);
+        assert_se(udev_monitor_enable_receiving(sender) >= 0);
+
+        for (i = 0; i < ELEMENTSOF(filter_devices); i++) {
+                char syspath[UTIL_PATH_SIZE];
+
+                snprintf(syspath, sizeof(syspath), "/sys/devices/virtual/mem/%s", filter_devices[i]);
+                devices[i] = udev_device_new_from_synthetic_event(udev, syspath, "change");
+                assert_se(devices[i] != NULL);
+                snprintf(name, sizeof(name), "serial-%s", filter_devices[i]);
+                assert_se(udev_device_add_property(devices[i], "ID_SERIAL", name) >= 0);
+        }
+        assert_se(udev_device_add_tag(devices[0], "seat") >= 0);
+
+        printf("monitor filter sysname\n");
+        receiver = monitor_filter_new(udev);
+        assert_se(udev_monitor_filter_add_match_subsystem_devtype(receiver, "mem", NULL) >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "null") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "full") >= 0);
+        monitor_filter_check(sender, receiver, devices, "null full");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter sysname glob\n");
+        receiver = monitor_filter_new(udev);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "z*") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "random") >= 0);
+        monitor_filter_check(sender, receiver, devices, "zero random");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter sysname, too many for the socket filter\n");
+        receiver = monitor_filter_new(udev);
+        for (i = 0; i < 300; i++) {
+                snprintf(name, sizeof(name), "nonexistent%u", i);
+                assert_se(udev_monitor_filter_add_match_sysname(receiver, name) >= 0);
+        }
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "zero") >= 0);
+        monitor_filter_check(sender, receiver, devices, "zero");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter property\n");
+        receiver = monitor_filter_new(udev);
+        assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", "serial-zero") >= 0);
+        assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", "serial-random") >= 0);
+        monitor_filter_check(sender, receiver, devices, "zero random");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter property glob and sysname\n");
+        receiver = monitor_filter_new(udev);
+        assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", "serial-*l*") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "full") >= 0);
+        monitor_filter_check(sender, receiver, devices, "full");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter property, too many for the socket filter\n");
+        receiver = monitor_filter_new(udev);
+        for (i = 0; i < 50; i++) {
+                snprintf(name, sizeof(name), "nonexistent%u", i);
+                assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", name) >= 0);
+        }
+        assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", "serial-null") >= 0);
+        monitor_filter_check(sender, receiver, devices, "null");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter tag, too many for the socket filter\n");
+        receiver = monitor_filter_new(udev);
+        for (i = 0; i < 60; i++) {
+                snprintf(name, sizeof(name), "nonexistent%u", i);
+                assert_se(udev_monitor_filter_add_match_tag(receiver, name) >= 0);
+        }
+        assert_se(udev_monitor_filter_add_match_tag(receiver, "seat") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "null") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "zero") >= 0);
+        monitor_filter_check(sender, receiver, devices, "null");
+        udev_monitor_unref(receiver);
+
+        printf("monitor filter tag, sysname and property, too many for the socket filter\n");
+        receiver = monitor_filter_new(udev);
+        for (i = 0; i < 60; i++) {
+                snprintf(name, sizeof(name), "nonexistent%u", i);
+                assert_se(udev_monitor_filter_add_match_tag(receiver, name) >= 0);
+        }
+        assert_se(udev_monitor_filter_add_match_tag(receiver, "seat") >= 0);
+        for (i = 0; i < 200; i++) {
+                snprintf(name, sizeof(name), "nonexistent%u", i);
+                assert_se(udev_monitor_filter_add_match_sysname(receiver, name) >= 0);
+        }
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "null") >= 0);
+        for (i = 0; i < 38; i++) {
+                snprintf(name, sizeof(name), "nonexistent%u", i);
+                assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", name) >= 0);
+        }
+        assert_se(udev_monitor_filter_add_match_property(receiver, "ID_SERIAL", "serial-null") >= 0);
+        monitor_filter_check(sender, receiver, devices, "null");
+        udev_monitor_unref(receiver);
+
+        printf("monitor receive devices\n");
+        receiver = monitor_filter_new(udev);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "null") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "zero") >= 0);
+        assert_se(udev_monitor_filter_add_match_sysname(receiver, "r*") >= 0);
+        test_monitor_receive_devices(sender, receiver, devices);
+        udev_monitor_unref(receiver);
+
+        for (i = 0; i < ELEMENTSOF(filter_devices); i++)
+                udev_device_unref(devices[i]);
+        udev_monitor_unref(sender);
+        printf("\n");
+}
+
 static int test_queue(struct udev *udev) {
         struct udev_queue *udev_queue;
 
@@ -389,7 +583,219 @@ static int test_enumerate(struct udev *udev, const char *subsystem) {
         return 0;
 }
 
+static int enumerate_stream_add(struct udev_enumerate *udev_enumerate, struct udev_device *device, void *userdata) {
+        Set *syspaths = userdata;
+        char *syspath;
+
+        syspath = strdup(udev_device_get_syspath(device));
+        if (syspath == NULL)
+                return -ENOMEM;
+        /* every device is passed once */
+        assert_se(set_consume(syspaths, syspath) > 0);
+        return 0;
+}
+
+/* a streaming scan passes the devices of the sorted list of a scan */
+static void test_enumerate_stream(struct udev *udev, const char *subsystem) {
+        _cleanup_udev_enumerate_unref_ struct udev_enumerate *udev_enumerate = NULL;
+        _cleanup_set_free_free_ Set *syspaths = NULL;
+        struct udev_list_entry *list_entry;
+        unsigned int n = 0;
+
+        printf("enumerate stream '%s'\n", subsystem == NULL ? "<all>" : subsystem);
+        udev_enumerate = udev_enumerate_new(udev);
+        assert_se(udev_enumerate != NULL);
+        if (subsystem != NULL)
+                assert_se(udev_enumerate_add_match_subsystem(udev_enumerate, subsystem) >= 0);
+
+        syspaths = set_new(&string_hash_ops);
+        assert_se(syspaths != NULL);
+        assert_se(udev_enumerate_scan_devices_stream(udev_enumerate, enumerate_stream_add, syspaths) >= 0);
+        assert_se(udev_enumerate_get_list_entry(udev_enumerate) == NULL);
+
+        assert_se(udev_enumerate_scan_devices(udev_enumerate) >= 0);
+        udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(udev_enumerate)) {
+                assert_se(set_contains(syspaths, udev_list_entry_get_name(list_entry)));
+                n++;
+        }
+        assert_se(set_size(syspaths) == n);
+        printf("found %u devices\n\n", n);
+}
+
+/* a parallel scan results in the same sorted list as a sequential one */
+static void test_enumerate_threads(struct udev *udev, const char *subsystem) {
+        _cleanup_udev_enumerate_unref_ struct udev_enumerate *sequential = NULL;
+        _cleanup_udev_enumerate_unref_ struct udev_enumerate *parallel = NULL;
+        struct udev_list_entry *entry_s, *entry_p;
+        unsigned int n = 0;
+
+        printf("enumerate threads '%s'\n", subsystem == NULL ? "<all>" : subsystem);
+        sequential = udev_enumerate_new(udev);
+        parallel = udev_enumerate_new(udev);
+        assert_se(sequential != NULL && parallel != NULL);
+        if (subsystem != NULL) {
+                assert_se(udev_enumerate_add_match_subsystem(sequential, subsystem) >= 0);
+                assert_se(udev_enumerate_add_match_subsystem(parallel, subsystem) >= 0);
+        }
+        assert_se(udev_enumerate_set_scan_threads(parallel, 4) >= 0);
+
+        assert_se(udev_enumerate_scan_devices(sequential) >= 0);
+        assert_se(udev_enumerate_scan_devices(parallel) >= 0);
+
+        entry_s = udev_enumerate_get_list_entry(sequential);
+        entry_p = udev_enumerate_get_list_entry(parallel);
+        while (entry_s != NULL && entry_p != NULL) {
+                assert_se(streq(udev_list_entry_get_name(entry_s), udev_list_entry_get_name(entry_p)));
+                entry_s = udev_list_entry_get_next(entry_s);
+                entry_p = udev_list_entry_get_next(entry_p);
+                n++;
+        }
+        assert_se(entry_s == NULL && entry_p == NULL);
+        printf("found %u devices\n\n", n);
+}
+
+/* the cache finds the devices of a scan by syspath, device number and property */
+static void test_device_cache(struct udev *udev) {
+        struct udev_device_cache *cache;
+        _cleanup_udev_enumerate_unref_ struct udev_enumerate *udev_enumerate = NULL;
+        struct udev_list_entry *list_entry;
+        unsigned int n = 0, n_cache = 0, n_mem = 0;
+        int r;
+
+        printf("device cache\n");
+        cache = udev_device_cache_new(udev);
+        assert_se(cache != NULL);
+        assert_se(udev_device_cache_add_property_index(cache, "SUBSYSTEM") >= 0);
+        r = udev_device_cache_start(cache);
+        if (r < 0) {
+                printf("unable to start the device cache: %s\n\n", strerror(-r));
+                udev_device_cache_unref(cache);
+                return;
+        }
+
+        udev_enumerate = udev_enumerate_new(udev);
+        assert_se(udev_enumerate != NULL);
+        assert_se(udev_enumerate_scan_devices(udev_enumerate) >= 0);
+        udev_list_entry_foreach(list_entry, udev_enumerate_get_list_entry(udev_enumerate)) {
+                const char *syspath = udev_list_entry_get_name(list_entry);
+                struct udev_device *device;
+                dev_t devnum;
+
+                device = udev_device_cache_get_device_by_syspath(cache, syspath);
+                assert_se(device != NULL);
+                assert_se(streq(udev_device_get_syspath(device), syspath));
+
+                devnum = udev_device_get_devnum(device);
+                if (major(devnum) > 0) {
+                        char type = streq(udev_device_get_subsystem(device), "block") ? 'b' : 'c';
+                        struct udev_device *d;
+
+                        d = udev_device_cache_get_device_by_devnum(cache, type, devnum);
+                        assert_se(d != NULL);
+                        assert_se(udev_device_get_devnum(d) == devnum);
+                }
+                if (streq(udev_device_get_subsystem(device), "mem"))
+                        n_mem++;
+                n++;
+        }
+        assert_se(udev_device_cache_get_device_by_syspath(cache, "/sys/devices/nonexistent") == NULL);
+
+        udev_list_entry_foreach(list_entry, udev_device_cache_get_list_entry(cache))
+                n_cache++;
+        assert_se(n_cache == n);
+
+        udev_list_entry_foreach(list_entry, udev_device_cache_get_devices_by_property(cache, "SUBSYSTEM", "mem")) {
+                struct udev_device *device;
+
+                device = udev_device_cache_get_device_by_syspath(cache, udev_list_entry_get_name(list_entry));
+                assert_se(device != NULL);
+                assert_se(streq(udev_device_get_subsystem(device), "mem"));
+                n_mem--;
+        }
+        assert_se(n_mem == 0);
+        assert_se(udev_device_cache_get_devices_by_property(cache, "SUBSYSTEM", "nonexistent") == NULL);
+
+        printf("found %u devices\n\n", n);
+        assert_se(udev_device_cache_unref(cache) == NULL);
+}
+
+/* the properties of a lookup as "KEY=value" lines, sorted by key */
+static char *hwdb_properties(struct udev_list_entry *list) {
+        struct udev_list_entry *entry;
+        char *str;
+
+        str = strdup("");
+        assert_se(str != NULL);
+        udev_list_entry_foreach(entry, list) {
+                char *s;
+
+                s = strjoin(str, udev_list_entry_get_name(entry), "=", udev_list_entry_get_value(entry), "\n", NULL);
+                assert_se(s != NULL);
+                free(str);
+                str = s;
+        }
+        return str;
+}
+
+static int hwdb_batch_add(struct udev_hwdb *hwdb, size_t index, struct udev_list_entry *list, void *userdata) {
+        char **properties = userdata;
+
+        /* every key is passed once */
+        assert_se(properties[index] == NULL);
+        properties[index] = hwdb_properties(list);
+        return 0;
+}
+
+/* all lookup functions return the properties of udev_hwdb_get_properties_list_entry() */
+static char **hwdb_check(struct udev_hwdb *hwdb, const char * const *modaliases, size_t n) {
+        _cleanup_strv_free_ char **batch = NULL;
+        char **properties;
+        size_t i;
+
+        properties = new0(char *, n + 1);
+        batch = new0(char *, n + 1);
+        assert_se(properties != NULL && batch != NULL);
+
+        for (i = 0; i < n; i++)
+                properties[i] = hwdb_properties(udev_hwdb_get_properties_list_entry(hwdb, modaliases[i], 0));
+
+        assert_se(udev_hwdb_lookup_batch(hwdb, modaliases, n, hwdb_batch_add, batch) >= 0);
+        for (i = 0; i < n; i++)
+                assert_se(batch[i] != NULL && streq(batch[i], properties[i]));
+
+        /* the in-place lookup returns the same properties, in any order */
+        for (i = 0; i < n; i++) {
+                _cleanup_free_ char *lines = NULL;
+                unsigned int count = 0;
+                const char *p;
+                int r, j, k;
+
+                lines = strjoin("\n", properties[i], NULL);
+                assert_se(lines != NULL);
+                for (p = properties[i]; *p != '\0'; p++)
+                        if (*p == '\n')
+                                count++;
+
+                r = udev_hwdb_lookup(hwdb, modaliases[i]);
+                assert_se(r >= 0 && (unsigned int) r == count);
+                for (j = 0; j < r; j++) {
+                        _cleanup_free_ char *line = NULL;
+
+                        line = strjoin("\n", udev_hwdb_get_property_name(hwdb, j), "=",
+                                       udev_hwdb_get_property_value(hwdb, j), "\n", NULL);
+                        assert_se(line != NULL);
+                        assert_se(strstr(lines, line) != NULL);
+                        for (k = 0; k < j; k++)
+                                assert_se(!streq(udev_hwdb_get_property_name(hwdb, j), udev_hwdb_get_property_name(hwdb, k)));
+                }
+                assert_se(udev_hwdb_get_property_name(hwdb, r) == NULL);
+        }
+
+        return properties;
+}
+
 static void test_hwdb(struct udev *udev, const char *modalias) {
+        const char *modaliases[] = { modalias, "usb:v0D50p0011", "usb:v1D6Bp0002d0404", "usb:v0D50p0011", "nonexistent" };
         struct udev_hwdb *hwdb;
         struct udev_list_entry *entry;
 
@@ -399,10 +805,42 @@ static void test_hwdb(struct udev *udev, const char *modalias) {
                 printf("'%s'='%s'\n", udev_list_entry_get_name(entry), udev_list_entry_get_value(entry));
         printf("\n");
 
+        if (hwdb != NULL)
+                strv_free(hwdb_check(hwdb, modaliases, ELEMENTSOF(modaliases)));
+
         hwdb = udev_hwdb_unref(hwdb);
         assert(hwdb == NULL);
 }
 
+/* databases built from the same sources return the same properties, whatever their format */
+static void test_hwdb_files(struct udev *udev, char **files, const char * const *modaliases, size_t n) {
+        _cleanup_strv_free_ char **first = NULL;
+        char **file;
+        size_t i;
+
+        STRV_FOREACH(file, files) {
+                struct udev_hwdb *hwdb;
+                char **properties;
+
+                printf("hwdb '%s'\n", *file);
+                hwdb = udev_hwdb_new_from_path(udev, *file);
+                assert_se(hwdb != NULL);
+                properties = hwdb_check(hwdb, modaliases, n);
+                udev_hwdb_unref(hwdb);
+
+                if (first == NULL) {
+                        first = properties;
+                        continue;
+                }
+                for (i = 0; i < n; i++)
+                        assert_se(streq(properties[i], first[i]));
+                strv_free(properties);
+        }
+
+        for (i = 0; i < n; i++)
+                printf("K: %s\n%s\n", modaliases[i], first[i]);
+}
+
 int main(int argc, char *argv[]) {
         struct udev *udev = NULL;
         static const struct option options[] = {
@@ -411,10 +849,12 @@ int main(int argc, char *argv[]) {
                 { "debug", no_argument, NULL, 'd' },
                 { "help", no_argument, NULL, 'h' },
                 { "version", no_argument, NULL, 'V' },
+                { "hwdb", required_argument, NULL, 'w' },
                 {}
         };
         const char *syspath = "/devices/virtual/mem/null";
         const char *subsystem = NULL;
+        _cleanup_strv_free_ char **hwdb_files = NULL;
         char path[1024];
         int c;
 
@@ -425,7 +865,7 @@ int main(int argc, char *argv[]) {
                 return 1;
         }
 
-        while ((c = getopt_long(argc, argv, "p:s:dhV", options, NULL)) >= 0)
+        while ((c = getopt_long(argc, argv, "p:s:dhVw:", options, NULL)) >= 0)
                 switch (c) {
 
                 case 'p':
@@ -441,8 +881,13 @@ int main(int argc, char *argv[]) {
                                 log_set_max_level(LOG_INFO);
                         break;
 
+                case 'w':
+                        if (strv_extend(&hwdb_files, optarg) < 0)
+                                goto out;
+                        break;
+
                 case 'h':
-                        printf("--debug --syspath= --subsystem= --help\n");
+                        printf("--debug --syspath= --subsystem= --hwdb=FILE MODALIAS... --help\n");
                         goto out;
 
                 case 'V':
@@ -457,6 +902,12 @@ int main(int argc, char *argv[]) {
                 }
 
 
+        /* only compare the lookups of the keys in the given databases */
+        if (hwdb_files != NULL) {
+                test_hwdb_files(udev, hwdb_files, (const char * const *) argv + optind, argc - optind);
+                goto out;
+        }
+
         /* add sys path if needed */
         if (!startswith(syspath, "/sys")) {
                 snprintf(path, sizeof(path), "/sys/%s", syspath);
@@ -469,6 +920,14 @@ int main(int argc, char *argv[]) {
         test_device_parents(udev, syspath);
 
         test_enumerate(udev, subsystem);
+        test_enumerate_stream(udev, subsystem);
+        test_enumerate_stream(udev, "block");
+        test_enumerate_threads(udev, subsystem);
+        test_enumerate_threads(udev, "block");
+
+        test_device_cache(udev);
+
+        test_monitor_filter(udev);
 
         test_queue(udev);
 
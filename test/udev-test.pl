@@ -425,6 +425,17 @@ KERNEL=="sda", ATTR{nofile}=="", SYMLINK+="empty"
 KERNEL=="sda", ATTR{nofile}!="?*", SYMLINK+="not-something"
 KERNEL=="sda", TEST!="nofile", SYMLINK+="non-existent"
 KERNEL=="sda", SYMLINK+="wrong"
+EOF
+        },
+        {
+                desc            => "ATTR (file written by a rule)",
+                devpath         => "/devices/pci0000:00/0000:00:1f.2/host0/target0:0:0/0:0:0:0/block/sda",
+                exp_name        => "written" ,
+                rules           => <<EOF
+SUBSYSTEM=="block", ATTR{make-it-fail}=="1", SYMLINK+="wrong"
+KERNEL=="sda", ATTR{make-it-fail}="1"
+SUBSYSTEM=="block", ATTR{make-it-fail}=="1", SYMLINK+="written"
+KERNEL=="sda", ATTR{make-it-fail}="0"
 EOF
         },
         {